@@ -51,46 +51,56 @@
  * DHT22_DATA_t sensor_values;
  * DHT22_ERROR_t error;
  * cli();
- * error = readDHT22(&sensor_values);
+ * error = readDHT22(0, &sensor_values);
  * sei();
  *
+ * Or use the common driver interface (DHT22drv.h) with
+ * DHT22_BACKEND_BUSYWAIT, it disables the interrupts itself.
+ *
  * Remember to configure the pin where the sensor is connected
- * at the header file (DHT22.h).
+ * at config/conf_dht.h.
  */
+#include <avr/interrupt.h>
+
 #include "DHT22.h"
 
-DHT22_ERROR_t readDHT22(DHT22_DATA_t* data)
+DHT22_ERROR_t readDHT22(uint8_t sensor, DHT22_DATA_t* data)
 {
 
 	uint8_t retryCount = 0;
-	uint8_t csPart1, csPart2, csPart3, csPart4;
-	uint16_t rawHumidity = 0;
-	uint16_t rawTemperature = 0;
-	uint8_t checkSum = 0;
+	uint8_t frame[DHT22_DATA_BIT_COUNT / 8]; // Humidity (2), temperature (2) and checksum (1) bytes.
+	uint8_t shiftReg = 1; // Bit 0 is a marker: when it is shifted out, 8 data bits were received.
+	uint8_t *framePtr = frame;
+	uint8_t byteDone;
+	uint8_t ackLow;
+	uint8_t bitThreshold = DHT22_BIT_THRESHOLD;
+	uint8_t pinMask = 1 << dht22_pins[sensor];
 	uint8_t i;
 
+	DHT22_HIST_SELECT(sensor);
+
 	// Pin needs to start HIGH, wait until it is HIGH with a timeout
 	retryCount = 0;
 //	cli();
-	DHT22_DDR &= ~(1 << ( DHT22_PIN ));
+	DHT22_DDR &= ~pinMask;
 //	sei();
 	do
 	{
 		if(retryCount > 125) return DHT_BUS_HUNG;
 		retryCount++;
 		_delay_us(2);
-	} while( !( DHT22_PORT_IN & ( 1 << DHT22_PIN ) ) );				//!DIRECT_READ(reg, bitmask)
+	} while( !( DHT22_PORT_IN & pinMask ) );				//!DIRECT_READ(reg, bitmask)
 
 	
 	// Send the activate pulse
 //	cli();
-	DHT22_PORT_OUT &= ~(1 << ( DHT22_PIN )); 							//DIRECT_WRITE_LOW(reg, bitmask);
-	DHT22_DDR |= 1 << ( DHT22_PIN );								//DIRECT_MODE_OUTPUT(reg, bitmask); // Output Low
+	DHT22_PORT &= ~pinMask; 							//DIRECT_WRITE_LOW(reg, bitmask);
+	DHT22_DDR |= pinMask;								//DIRECT_MODE_OUTPUT(reg, bitmask); // Output Low
 //	sei();
 	_delay_ms(2); 										// spec is 1 to 10ms
 //	cli();
-	DHT22_DDR &= ~(1 << ( DHT22_PIN ));							// Switch back to input so pin can float
-	DHT22_PORT_OUT |= (1 << ( DHT22_PIN )); // Enable pullup.
+	DHT22_DDR &= ~pinMask;							// Switch back to input so pin can float
+	DHT22_PORT |= pinMask; // Enable pullup.
 //	sei();
 
 	// Find the start of the ACK signal
@@ -104,7 +114,7 @@ DHT22_ERROR_t readDHT22(DHT22_DATA_t* data)
 		}
 		retryCount++;
 		_delay_us(2);
-	} while( DHT22_PORT_IN & ( 1 << DHT22_PIN ) ); // While pin is 1.
+	} while( DHT22_PORT_IN & pinMask ); // While pin is 1.
 	// Aqui retrayCount foi 8 = 16us.
 	
 	// Here sensor responded pulling the line down DHT22_PIN = 0
@@ -116,11 +126,14 @@ DHT22_ERROR_t readDHT22(DHT22_DATA_t* data)
 		if (retryCount > 50) 							//(Spec is 80 us, 50*2 == 100 us)
 		{
 			//data->retryCount = retryCount;
+			DHT22_HIST_ADD(DHT_HIST_ACK_LOW, retryCount);
 			return DHT_ERROR_ACK_TOO_LONG;
 		}
 		retryCount++;
 		_delay_us(2);
-	} while( !(DHT22_PORT_IN & ( 1 << DHT22_PIN )) );
+	} while( !(DHT22_PORT_IN & pinMask) );
+	DHT22_HIST_ADD(DHT_HIST_ACK_LOW, retryCount);
+	ackLow = retryCount;
 	// Aqui retryCount foi 27 = 54us.
 		
 	// Here sensor pulled up DHT22_PIN = 1
@@ -131,12 +144,22 @@ DHT22_ERROR_t readDHT22(DHT22_DATA_t* data)
 	{
 		if (retryCount > 50) 							//(Spec is 80 us, 50*2 == 100 us)
 		{
+			DHT22_HIST_ADD(DHT_HIST_ACK_HIGH, retryCount);
 			return DHT_ERROR_ACK_TOO_LONG;
 		}
 		retryCount++;
 		_delay_us(2);
-	} while( DHT22_PORT_IN & ( 1 << DHT22_PIN ) );
+	} while( DHT22_PORT_IN & pinMask );
+	DHT22_HIST_ADD(DHT_HIST_ACK_HIGH, retryCount);
 	// Aqui retryCount foi 28 = 56us.
+
+#if(DHT22_ADAPTIVE_THRESHOLD==1)
+	// Scale the bit threshold from the ACK timing (160us nominal), fixed point.
+	// With the values above: (27 + 28) * 3 / 8 = 20, the fixed threshold.
+	bitThreshold = ((uint16_t)(ackLow + retryCount) * 3) >> 3;
+	if (bitThreshold < DHT22_BIT_THRESHOLD_MIN) bitThreshold = DHT22_BIT_THRESHOLD_MIN;
+	if (bitThreshold > DHT22_BIT_THRESHOLD_MAX) bitThreshold = DHT22_BIT_THRESHOLD_MAX;
+#endif
 	
 	
 	// Here sensor pulled down to start transmitting bits.
@@ -150,11 +173,13 @@ DHT22_ERROR_t readDHT22(DHT22_DATA_t* data)
 		{
 			if (retryCount > 35) 						//(Spec is 50 us, 35*2 == 70 us)
 			{
+				DHT22_HIST_ADD(DHT_HIST_SYNC, retryCount);
 				return DHT_ERROR_SYNC_TIMEOUT;
 			}
 			retryCount++;
 			_delay_us(2);
-		} while( !(DHT22_PORT_IN & ( 1 << DHT22_PIN )) );
+		} while( !(DHT22_PORT_IN & pinMask) );
+		DHT22_HIST_ADD(DHT_HIST_SYNC, retryCount);
 
 		// No primeiro bit, retrayCount foi 18 = 36us.
 //		if (i == 0){
@@ -167,74 +192,71 @@ DHT22_ERROR_t readDHT22(DHT22_DATA_t* data)
 		{
 			if (retryCount > 50) 						//(Spec is 80 us, 50*2 == 100 us)
 			{
+				DHT22_HIST_ADD(DHT_HIST_DATA, retryCount);
 				return DHT_ERROR_DATA_TIMEOUT;
 			}
 			retryCount++;
 			_delay_us(2);
-		} while( DHT22_PORT_IN & ( 1 << DHT22_PIN ) );
+		} while( DHT22_PORT_IN & pinMask );
+		DHT22_HIST_ADD(DHT_HIST_DATA, retryCount);
 
-		// Identification of bit values.
-		if (retryCount > 20) // Bit is 1: 20*2 = 40us (specification for bit 0 is 26 a 28us).
+		// Identification of bit values. Bits are shifted MSB first into
+		// shiftReg, a variable shift (1 << n) would be a loop on AVR.
+		byteDone = shiftReg & 0x80; // Marker is about to leave: this is the 8th bit of the byte.
+		shiftReg <<= 1;
+		if (retryCount > bitThreshold) // Bit is 1: 20*2 = 40us nominal (specification for bit 0 is 26 a 28us).
 		{
-			if (i < 16) // Humidity 
-			{
-				rawHumidity |= (1 << (15 - i));
-			}
-			if ((i > 15) && (i < 32))  // Temperature
-			{
-				rawTemperature |= (1 << (31 - i));
-			}
-			if ((i > 31) && (i < 40))  // CRC data
-			{
-				checkSum |= (1 << (39 - i));
-			}
+			shiftReg |= 1;
+		}
+		if (byteDone)
+		{
+			*framePtr++ = shiftReg;
+			shiftReg = 1;
 		}
 	}
 
 	// translate bitTimes
 	// 26~28us == logical 0
 	// 70us	   == logical 1
-	// here threshold is 40us
+	// here threshold is 40us, fixed or adaptive for a nominal ACK (20 counts of 2us,
+	// limited to 24us to 60us when adaptive)
 
-	// calculate checksum
-	csPart1 = rawHumidity >> 8;
-	csPart2 = rawHumidity & 0xFF;
-	csPart3 = rawTemperature >> 8;
-	csPart4 = rawTemperature & 0xFF;
-	
-	if( checkSum == ( (csPart1 + csPart2 + csPart3 + csPart4) & 0xFF ) )
-	{
-#if(OUTPUT_RAW_VALUES==0)
-		// raw data to sensor values
-		data->humidity_integral = (uint8_t)(rawHumidity / 10);
-		data->humidity_decimal = (uint8_t)(rawHumidity % 10);
-
-		if(rawTemperature & 0x8000)	// Check if temperature is below zero, non standard way of encoding negative numbers!
-		{
-			rawTemperature &= 0x7FFF; // Remove signal bit
-			data->temperature_integral = (int8_t)(rawTemperature / 10) * -1;
-			data->temperature_decimal = (uint8_t)(rawTemperature % 10);
-		} else
-		{
-			data->temperature_integral = (int8_t)(rawTemperature / 10);
-			data->temperature_decimal = (uint8_t)(rawTemperature % 10);			
-		}
-#else
-		if(rawTemperature & 0x8000)	// Check if temperature is below zero, non standard way of encoding negative numbers!
-		{
-			rawTemperature &= 0x7FFF; // Remove signal bit
-			data->raw_temperature = ((int16_t)rawTemperature) * -1;
-		} else
-		{
-			data->raw_temperature  = rawTemperature;
-		}	
-		data->raw_humidity = rawHumidity;
-#endif
-		return DHT_ERROR_NONE;
-	}
-	return DHT_ERROR_CHECKSUM;
+	// calculate checksum and extract the fields (done once, after the transfer)
+	return DHT22_DecodeFrame(frame, data);
 }
 
+#if (DHT22_BACKEND == DHT22_BACKEND_BUSYWAIT)
+
+/* Common driver interface (DHT22drv.h) on top of readDHT22() */
+static DHT22_STATUS_t status = DHT_STOPPED;
+static DHT22_DATA_t result;
+
+void DHT22_Init(void)
+{
+	status = DHT_STOPPED;
+}
 
+/*
+ * Reads the sensor. Returns only when the reading is done.
+ * Interrupts are disabled while reading, the previous state is restored.
+ */
+DHT22_STATUS_t DHT22_StartReading(uint8_t sensor)
+{
+	uint8_t sreg = SREG;
+	
+	cli();
+	status = readDHT22(sensor, &result);
+	SREG = sreg;
+	return DHT_STARTED;
+}
 
+DHT22_STATUS_t DHT22_CheckStatus(DHT22_DATA_t* data)
+{
+	if (status == DHT_DATA_READY)
+	{
+		*data = result;
+	}
+	return status;
+}
 
+#endif
@@ -21,6 +21,7 @@
  * This lib is blocking, it not uses interrupts.
  * The processor keeps busy while reading sensor values.
  * The reading process can take almost 6ms (in the worst case).
+ * It is the DHT22_BACKEND_BUSYWAIT backend of DHT22drv.h.
  * Is this is too much for you, have a look at my 
  * interrupt driven DHT22 lib:
  * http://moretosprojects.blogspot.com.br/2014/01/dht22-interrupt-driven-library-for-avr.html
@@ -36,60 +37,34 @@
  * 
  * Miguel Moreto, Brazil, 2013.
  */
-#define F_CPU 16000000UL
-
 #ifndef _DHT22_H_
 #define _DHT22_H_
 
+#include "DHT22drv.h"
+
 #include <util/delay.h>
 #include <avr/io.h>
 
-/* 
-Output format setting. Change to 1 to output a struct with
-the raw values from DHT22. If decimal and integral parts of
-the values are required leave equal to 0.
+/*
+Bit decision threshold. With DHT22_ADAPTIVE_THRESHOLD equal to 1 the
+threshold is scaled each reading from the sensor's own ACK (80us low +
+80us high): threshold = (ackLow + ackHigh) * 3 / 8, which gives the fixed
+DHT22_BIT_THRESHOLD (20) for the ACK counted on the bench (27 + 28), between
+bit 0 (26~28us) and bit 1 (70us). This follows cable capacitance, sensor
+clones and CPU clock tolerance. The result is limited to the MIN/MAX
+values. Change to 0 to use the fixed DHT22_BIT_THRESHOLD.
+All values are in retryCount units.
 */
-#define OUTPUT_RAW_VALUES 0
-
+#define DHT22_ADAPTIVE_THRESHOLD 1
+#define DHT22_BIT_THRESHOLD 20
+#define DHT22_BIT_THRESHOLD_MIN 12
+#define DHT22_BIT_THRESHOLD_MAX 30
 
-#define DHT22_DATA_BIT_COUNT 40
+/* Port and pins are configured at config/conf_dht.h */
 
-/* Configure port and pin */
-#define DHT22_PIN PD6
-#define DHT22_DDR DDRD
-#define DHT22_PORT_OUT PORTD
-#define DHT22_PORT_IN PIND
-
-typedef enum
-{
-  DHT_ERROR_NONE = 0,
-  DHT_BUS_HUNG = 1,
-  DHT_ERROR_NOT_PRESENT = 2,
-  DHT_ERROR_ACK_TOO_LONG = 3,
-  DHT_ERROR_SYNC_TIMEOUT = 4,
-  DHT_ERROR_DATA_TIMEOUT = 5,
-  DHT_ERROR_CHECKSUM = 6,
-} DHT22_ERROR_t;
-
-// Output format structure.
-#if(OUTPUT_RAW_VALUES==0)
-typedef struct
-{
-	int8_t temperature_integral;
-	uint8_t temperature_decimal;
-	uint8_t humidity_integral;
-	uint8_t humidity_decimal;
-	uint8_t retryCount;
-} DHT22_DATA_t;
-#else
-typedef struct
-{
-	int16_t raw_temperature;
-	uint16_t raw_humidity;
-} DHT22_DATA_t;
-#endif
+typedef DHT22_STATUS_t DHT22_ERROR_t;
 
-DHT22_ERROR_t readDHT22(DHT22_DATA_t* data);
+DHT22_ERROR_t readDHT22(uint8_t sensor, DHT22_DATA_t* data);
 
 
 #endif
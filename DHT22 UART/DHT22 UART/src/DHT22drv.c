@@ -0,0 +1,65 @@
+/*
+ * DHT22drv.c
+ *
+ * Common part of the DHT22 drivers: sensor pin table and frame decoding.
+ * See DHT22drv.h.
+ */
+
+#include "DHT22drv.h"
+
+#if (DHT22_BACKEND == DHT22_BACKEND_INT || DHT22_BACKEND == DHT22_BACKEND_ICP) && (DHT22_SENSOR_COUNT > 1)
+#error "The INT and ICP backends support only one sensor. Use the PCINT or BUSYWAIT backend."
+#endif
+
+/* Pins of the sensors at DHT22_PORT */
+const uint8_t dht22_pins[DHT22_SENSOR_COUNT] = DHT22_SENSOR_PINS;
+
+/*
+ * DHT22_STATUS_t DHT22_DecodeFrame(const uint8_t* frame, DHT22_DATA_t* data)
+ *
+ * Checks the checksum of a received frame (5 bytes: humidity, temperature
+ * and checksum) and extracts the sensor values.
+ * Returns DHT_ERROR_NONE or DHT_ERROR_CHECKSUM.
+ */
+DHT22_STATUS_t DHT22_DecodeFrame(const uint8_t* frame, DHT22_DATA_t* data)
+{
+	uint16_t rawHumidity;
+	uint16_t rawTemperature;
+	
+	// calculate checksum
+	if( frame[4] != (uint8_t)( frame[0] + frame[1] + frame[2] + frame[3] ) )
+	{
+		return DHT_ERROR_CHECKSUM;
+	}
+	
+	rawHumidity = ((uint16_t)frame[0] << 8) | frame[1];
+	rawTemperature = ((uint16_t)frame[2] << 8) | frame[3];
+	
+#if(OUTPUT_RAW_VALUES==0)
+	// raw data to sensor values
+	data->humidity_integral = (uint8_t)(rawHumidity / 10);
+	data->humidity_decimal = (uint8_t)(rawHumidity % 10);
+
+	if(rawTemperature & 0x8000)	// Check if temperature is below zero, non standard way of encoding negative numbers!
+	{
+		rawTemperature &= 0x7FFF; // Remove signal bit
+		data->temperature_integral = (int8_t)(rawTemperature / 10) * -1;
+		data->temperature_decimal = (uint8_t)(rawTemperature % 10);
+	} else
+	{
+		data->temperature_integral = (int8_t)(rawTemperature / 10);
+		data->temperature_decimal = (uint8_t)(rawTemperature % 10);
+	}
+#else
+	if(rawTemperature & 0x8000)	// Check if temperature is below zero, non standard way of encoding negative numbers!
+	{
+		rawTemperature &= 0x7FFF; // Remove signal bit
+		data->raw_temperature = ((int16_t)rawTemperature) * -1;
+	} else
+	{
+		data->raw_temperature  = rawTemperature;
+	}
+	data->raw_humidity = rawHumidity;
+#endif
+	return DHT_ERROR_NONE;
+}
@@ -0,0 +1,104 @@
+/*
+ * DHT22drv.h
+ *
+ * Common interface of the DHT22 drivers.
+ *
+ * The application uses only the functions and types of this file. The driver
+ * backend (blocking or interrupt driven) is selected at compile time with
+ * DHT22_BACKEND (config/conf_dht.h), so the same application code runs with
+ * any backend and they can be compared head-to-head.
+ *
+ * Example of use:
+ *
+ *      DHT22_STATUS_t status;
+ *      DHT22_DATA_t sensor_data;
+ *      DHT22_Init();
+ *      sei();
+ *
+ *      DHT22_StartReading(0);
+ *      do {
+ *          status = DHT22_CheckStatus(&sensor_data);
+ *      } while (status == DHT_BUSY);
+ *      if (status == DHT_DATA_READY){
+ *          // Do something with the data.
+ *      }
+ *
+ * With the blocking backend DHT22_StartReading() only returns when the reading
+ * is done (interrupts are disabled meanwhile, almost 6ms in the worst case).
+ * With the interrupt backends it returns at once and the reading is done by
+ * the interrupt handlers.
+ */
+
+#ifndef DHT22DRV_H_
+#define DHT22DRV_H_
+
+/* F_CPU is a project symbol (-DF_CPU=16000000UL), so every file, and the
+   avr-libc headers included before this one, see the same clock. */
+#ifndef F_CPU
+#error "F_CPU must be defined in the project symbols (-DF_CPU=16000000UL)."
+#endif
+
+#include <stdint.h>
+#include <avr/io.h>
+
+/* Backends */
+#define DHT22_BACKEND_BUSYWAIT 0
+#define DHT22_BACKEND_INT 1
+#define DHT22_BACKEND_PCINT 2
+#define DHT22_BACKEND_ICP 3
+
+#include "conf_dht.h"
+
+#if (OUTPUT_RAW_VALUES == 0)
+#error "The firmware needs OUTPUT_RAW_VALUES equal to 1 (config/conf_dht.h)."
+#endif
+
+#define DHT22_DATA_BIT_COUNT 40 // Number of bits that the sensor send.
+
+/* Status of a reading. The error codes are sent as they are by the application
+   ("ERROR,n"), do not change their values. */
+typedef enum
+{
+	DHT_ERROR_NONE = 0,			// Data is ok (same as DHT_DATA_READY).
+	DHT_BUS_HUNG = 1,			// Line stuck low (before the start, or after it with the interrupt backends).
+	DHT_ERROR_NOT_PRESENT = 2,	// Sensor did not respond to the start.
+	DHT_ERROR_ACK_TOO_LONG = 3,	// Sensor ACK out of the expected timing.
+	DHT_ERROR_SYNC_TIMEOUT = 4,	// Bit sync pulse too long.
+	DHT_ERROR_DATA_TIMEOUT = 5,	// Bit data pulse too long (or bits missing).
+	DHT_ERROR_CHECKSUM = 6,		// Checksum does not match.
+	DHT_BUSY,					// A reading is in progress.
+	DHT_STARTED,				// A reading has started.
+	DHT_STOPPED,				// No reading was started.
+} DHT22_STATUS_t;
+
+#define DHT_DATA_READY DHT_ERROR_NONE
+
+/* Sensor values */
+#if(OUTPUT_RAW_VALUES==0)
+typedef struct
+{
+	int8_t temperature_integral;
+	uint8_t temperature_decimal;
+	uint8_t humidity_integral;
+	uint8_t humidity_decimal;
+} DHT22_DATA_t;
+#else
+typedef struct
+{
+	int16_t raw_temperature; // 0.1 C
+	uint16_t raw_humidity; // 0.1 %
+} DHT22_DATA_t;
+#endif
+
+/* Function prototypes */
+void DHT22_Init(void);
+DHT22_STATUS_t DHT22_StartReading(uint8_t sensor);
+DHT22_STATUS_t DHT22_CheckStatus(DHT22_DATA_t* data);
+
+/* Used by the backends */
+DHT22_STATUS_t DHT22_DecodeFrame(const uint8_t* frame, DHT22_DATA_t* data);
+extern const uint8_t dht22_pins[DHT22_SENSOR_COUNT];
+
+#include "DHT22hist.h"
+
+#endif /* DHT22DRV_H_ */
@@ -0,0 +1,26 @@
+/*
+ * DHT22hist.c
+ *
+ * Pulse width histograms for the DHT22 drivers.
+ * See DHT22hist.h.
+ */
+#include <string.h>
+
+#include "DHT22drv.h"
+
+#if (DHT22_HISTOGRAM == 1)
+
+DHT22_HIST_t dht22_hist[DHT22_SENSOR_COUNT];
+DHT22_HIST_t *dht22_hist_sel = &dht22_hist[0];
+
+/*
+ * void DHT22_HistClear(void)
+ *
+ * Clears the histograms of all sensors. Call with the driver stopped (or interrupts disabled).
+ */
+void DHT22_HistClear(void)
+{
+	memset(&dht22_hist, 0, sizeof(dht22_hist));
+}
+
+#endif
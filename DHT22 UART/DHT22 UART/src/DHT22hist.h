@@ -0,0 +1,79 @@
+/*
+ * DHT22hist.h
+ *
+ * Pulse width histograms for the DHT22 drivers.
+ *
+ * Optional instrumentation: when DHT22_HISTOGRAM is 1 (config/conf_dht.h),
+ * each measured pulse width is accumulated in a histogram kept in RAM, one
+ * set per sensor. The histograms show how close the real pulses are to the
+ * thresholds used by the drivers, so the thresholds can be tuned from real
+ * cabling instead of guessing.
+ *
+ * Width units depend on the backend:
+ *   DHT22.c    => retryCount (one loop iteration, aprox. 2us + loop overhead).
+ *   DHT22int.c => counter_us (timer ticks, DHT22_TICK_US).
+ * Bin n counts the widths from (n << DHT22_HIST_SHIFT) to
+ * ((n + 1) << DHT22_HIST_SHIFT) - 1. The last bin also counts all widths
+ * above its range (timeouts). Counters saturate at 0xFFFF.
+ *
+ * RAM usage: DHT_HIST_KINDS * DHT22_HIST_BINS * 2 bytes (256 bytes) per sensor.
+ */
+
+#ifndef DHT22HIST_H_
+#define DHT22HIST_H_
+
+#include <stdint.h>
+
+#define DHT22_HIST_BINS 32
+
+#if (DHT22_BACKEND == DHT22_BACKEND_BUSYWAIT)
+#define DHT22_HIST_SHIFT 1 // Bins of 2 counts.
+#else
+#define DHT22_HIST_SHIFT 2 // Bins of 4 ticks.
+#endif
+
+/* Kind of pulse being measured */
+typedef enum
+{
+	DHT_HIST_ACK_LOW = 0,	// Sensor ACK, line low (aprox. 80us).
+	DHT_HIST_ACK_HIGH,		// Sensor ACK, line high (aprox. 80us).
+	DHT_HIST_SYNC,			// Bit sync, line low (aprox. 50us). Blocking driver only.
+	DHT_HIST_DATA,			// Bit data, line high (26~28us or 70us). The interrupt driver
+							// measures sync + data (78us or 120us).
+	DHT_HIST_KINDS,
+} DHT22_HIST_KIND_t;
+
+typedef struct
+{
+	uint16_t bin[DHT_HIST_KINDS][DHT22_HIST_BINS];
+} DHT22_HIST_t;
+
+#if (DHT22_HISTOGRAM == 1)
+
+extern DHT22_HIST_t dht22_hist[DHT22_SENSOR_COUNT];
+extern DHT22_HIST_t *dht22_hist_sel; // Histograms of the sensor being read.
+
+/* Accumulates one pulse width. Short enough to be called from the interrupt handler. */
+static inline void DHT22_HistAdd(uint8_t kind, uint8_t width)
+{
+	uint8_t n = width >> DHT22_HIST_SHIFT;
+	uint16_t *counter;
+	
+	if (n >= DHT22_HIST_BINS) n = DHT22_HIST_BINS - 1;
+	counter = &dht22_hist_sel->bin[kind][n];
+	if (*counter != 0xFFFF) (*counter)++;
+}
+
+#define DHT22_HIST_SELECT(sensor) dht22_hist_sel = &dht22_hist[sensor]
+#define DHT22_HIST_ADD(kind,width) DHT22_HistAdd(kind,width)
+
+void DHT22_HistClear(void);
+
+#else
+
+#define DHT22_HIST_SELECT(sensor)
+#define DHT22_HIST_ADD(kind,width)
+
+#endif
+
+#endif /* DHT22HIST_H_ */
@@ -32,11 +32,14 @@
  * display during the measurement of the sensor data.
  *
  * REQUIREMENTS: 
- *   A pin with external interrupt (INT0, INT1 or other).
+ *   A pin with external interrupt (INT0, INT1 or other), pin change
+ *   interrupt or the timer input capture pin.
  *   A timer with Clear Timer on Compare Match mode (CTC).
- *   Timer prescaler that gives a timer frequency of 1MHz.
+ *   Timer prescaler that gives a timer tick of 1us or 2us (DHT22_TICK_US).
  *
- *   Pin change interrupt is not supported yet.
+ * This file implements the DHT22_BACKEND_INT, DHT22_BACKEND_PCINT and
+ * DHT22_BACKEND_ICP backends of DHT22drv.h. They share the state machine,
+ * only the edge interrupt differs (see the macros at DHT22int.h).
  *
  * HOW IT WORKS:
  * Check the comments in this file to fully understand how it works. Basically:
@@ -45,20 +48,18 @@
  *      handler function).
  *   2) Pin is switched to input with external interrupt. At each external
  *      interrupt the number of timer ticks (configured to occur at each
- *      microsecond) is counted.
- *   3) The value of the counter (microseconds) is compared with a fixed
+ *      DHT22_TICK_US microseconds) is counted.
+ *   3) The value of the counter (ticks) is compared with a fixed
  *      value in a state machine, this way, the signal from DHT22 is
  *      interpreted. This is done at the External Interrupt Handler.
  *
  * HOW TO USE:
- *  Include the lib:
+ *  Select the backend at config/conf_dht.h and use the common interface,
+ *  see DHT22drv.h:
  *
- *      #include "DHT22int.h"
+ *      #include "DHT22drv.h"
  *
- *  Before entering the main loop of your program, declare some needed variables
- *  call the init function and enable interrupts.
- *
- *      DHT22_STATE_t state;
+ *      DHT22_STATUS_t status;
  *      DHT22_DATA_t sensor_data;
  *      DHT22_Init();
  *      sei();
@@ -66,25 +67,21 @@
  *  Periodically (or not, depending of your use), call the function to 
  *  start reading the sensor:
  *
- *      state = DHT22_StartReading();
+ *      status = DHT22_StartReading(0);
  *
- *  Check the state if you want to confirm that the state machine has started.
+ *  Check the status if you want to confirm that the state machine has started.
  *  In your main loop, check periodically when the data is available and in
  *  case of available, do something:
  *
- *      state = DHT22_CheckStatus(&sensor_data);
+ *      status = DHT22_CheckStatus(&sensor_data);
  *
- * 		if (state == DHT_DATA_READY){
+ * 		if (status == DHT_DATA_READY){
  *	 		// Do something with the data.
- *          // sensor_data.temperature_integral
- *          // sensor_data.temperature_decimal
- *          // sensor_data.humidity_integral
- *          // sensor_data.humidity_decimal
  * 		}
- *		else if (state == DHT_ERROR_CHECKSUM){
+ *		else if (status == DHT_ERROR_CHECKSUM){
  *	 		// Do something if there is a Checksum error
  *		}
- * 		else if (state == DHT_ERROR_NOT_RESPOND){
+ * 		else if (status != DHT_BUSY){
  *	 		// Do something if the sensor did not respond
  * 		}
  *
@@ -99,16 +96,45 @@
 #include <avr/interrupt.h>
 
 #include "DHT22int.h"
+#include "prof.h"
+
+#if (DHT22_BACKEND != DHT22_BACKEND_BUSYWAIT)
+
+/* States of the state machine */
+typedef enum
+{
+	DHT_IDLE = 0,
+	DHT_HOST_START,
+	DHT_HOST_PULLUP,
+	DHT_WAIT_SENSOR_RESPONSE,
+	DHT_SENSOR_PULLUP,
+	DHT_TRANSFERING,
+	DHT_CHECK_CRC,
+	DHT_DONE,
+} DHT22_STATE_t;
 
 /* Global variables for this file */
-DHT22_STATE_t state;
+volatile DHT22_STATE_t state;
+DHT22_STATUS_t status = DHT_STOPPED; // Result of the reading, valid at DHT_DONE.
 uint8_t overflow_cnt = 0;
-uint8_t bitcounter = 0;
+uint8_t pin_mask; // Pin of the sensor being read.
+#if (DHT22_BACKEND == DHT22_BACKEND_PCINT)
+uint8_t edge_level; // Pin level after the selected edge.
+#elif (DHT22_BACKEND == DHT22_BACKEND_ICP)
+uint16_t icp_last; // Timer1 at the previous edge.
+#endif
 
-uint8_t csPart1, csPart2, csPart3, csPart4;
-uint16_t rawHumidity = 0;
-uint16_t rawTemperature = 0;
-uint8_t checkSum = 0;
+/* Received frame: humidity (2 bytes), temperature (2 bytes) and checksum.
+   Bits are shifted into shift_reg MSB first. shift_reg starts as 1, this bit is a
+   marker: when it is about to be shifted out, the byte is complete and is stored
+   at frame[frame_idx]. The fields are extracted only once, in DHT22_CheckStatus. */
+uint8_t frame[DHT22_DATA_BIT_COUNT / 8];
+uint8_t frame_idx = 0;
+uint8_t shift_reg = 1;
+
+/* Bit decision threshold (ticks), see DHT22_ADAPTIVE_THRESHOLD. */
+uint8_t bit_threshold = DHT22_BIT_THRESHOLD;
+uint8_t ack_low_us = 0;
 
 /* NOTE: Check the macro definitions at the header file. */
 
@@ -117,11 +143,24 @@ uint8_t checkSum = 0;
  * Timer Compare Match interrupt handler
  *
  * This handler is used to generate host start conditions (Periods P1 and P2).
- * Using a 8bit timer with prescaler such that a timer tick corresponds to 1us (freq. = 1MHz).
+ * Using a 8bit timer with prescaler such that a timer tick corresponds to DHT22_TICK_US.
+ * With PROF_ENABLE (prof.h) the body is inlined between the profiling markers,
+ * so its early returns do not skip PROF_END.
  */
+#if (PROF_ENABLE == 1)
+static inline void timer_handler(void) __attribute__((always_inline));
 ISR(TIMER_CTC_VECTOR){
+	PROF_BEGIN(PROF_TIMER);
+	timer_handler();
+	PROF_END(PROF_TIMER);
+}
+static inline void timer_handler(void)
+#else
+ISR(TIMER_CTC_VECTOR)
+#endif
+{
 	
-	/* Using a 8bit timer maximum delay is 255us, we need at least 500us in Period P1.
+	/* Using a 8bit timer maximum delay is 255 ticks, we need at least 500us in Period P1.
 	   Se, we need two timer interrupts. We check this with overflow_cnt and comparing
 	   it the the define OVERFLOWS_HOST_START.
 	   We make the pin = 0 at the begining of the state machine (function DHT22_StartReading) */
@@ -129,12 +168,12 @@ ISR(TIMER_CTC_VECTOR){
 		overflow_cnt++;
 	}
 	/* After Period P1, we need to hold the pin high for aprox. 40us. So, we change timer compare
-	   register to 40. */
-	else if((state == DHT_HOST_START) && (overflow_cnt >= (OVERFLOWS_HOST_START - 1))){ // 510us have passed.
-		PIN_HIGH(DHT22_PORT,DHT22_PIN); // Change pin to High for period P2.
+	   register to 40us. */
+	else if((state == DHT_HOST_START) && (overflow_cnt >= (OVERFLOWS_HOST_START - 1))){ // 510 ticks have passed.
+		PIN_HIGH(DHT22_PORT,pin_mask); // Change pin to High for period P2.
 		overflow_cnt = 0;
 		state = DHT_HOST_PULLUP;
-		TIMER_OCR_REGISTER = 40;
+		TIMER_OCR_REGISTER = DHT22_US(40);
 		return;
 	}
 	/* The Period P2 have passed. We need now to change the pin to input and wait for sensor
@@ -144,25 +183,35 @@ ISR(TIMER_CTC_VECTOR){
 		TIMER_OCR_REGISTER = 255; // Change timer compare to 255, for now on, the timer interrupt should not fire.
 		                          // If if fires, too much time has passed and something is wrong. We will clear
 					              // the timer counter at the beggining of the external interrupt handler.
-		SET_PIN_INPUT(DHT22_DDR,DHT22_PIN); // Set pin as input.
-		PIN_HIGH(DHT22_PORT,DHT22_PIN); // Write 1 to enable pullup.
+		SET_PIN_INPUT(DHT22_DDR,pin_mask); // Set pin as input.
+		PIN_HIGH(DHT22_PORT,pin_mask); // Write 1 to enable pullup.
 		EXT_INTERRUPT_DISABLE  // Disable external interrupt (in case it is already enable)
 		EXT_INTERRUPT_SET_RISING_EDGE // Setting ext. int to rising edge.
 		EXT_INTERRUPT_CLEAR_FLAG // Clear flag to avoid spurious firing of ext. int.
 		EXT_INTERRUPT_ENABLE  // Re-enable external int.
 		TIMER_COUNTER_REGISTER = 0; // Reset counter
+		EXT_INTERRUPT_RESTART_WIDTH
 		state = DHT_WAIT_SENSOR_RESPONSE; // Change state.
 		return; // Return of the int. handler.
 	}
 	/* If the timer interrupt fired while not in the previous states, than too much time
-	   has passed and we signal a error. */
+	   has passed and we signal a error, according with the state. */
 	else{ 
-		state = DHT_ERROR_NOT_RESPOND; // Change to a error state
+		if (state == DHT_WAIT_SENSOR_RESPONSE){
+			// No rising edge: a line still low is held by a hung sensor, a high one was never pulled.
+			status = (DHT22_PORT_IN & pin_mask) ? DHT_ERROR_NOT_PRESENT : DHT_BUS_HUNG;
+		}
+		else if (state == DHT_SENSOR_PULLUP){
+			status = DHT_ERROR_ACK_TOO_LONG;
+		}
+		else{
+			status = DHT_ERROR_DATA_TIMEOUT;
+		}
+		state = DHT_DONE; // Change to the final state
 		TIMER_STOP // Stop timer.
 		EXT_INTERRUPT_DISABLE  // Disable external interrupt
-		SET_PIN_OUTPUT(DHT22_DDR,DHT22_PIN); // Set pin back to output.
-		PIN_HIGH(DHT22_PORT,DHT22_PIN); // Set pin high to disable DHT22.
-		bitcounter = 0; // reset bit counter.
+		SET_PIN_OUTPUT(DHT22_DDR,pin_mask); // Set pin back to output.
+		PIN_HIGH(DHT22_PORT,pin_mask); // Set pin high to disable DHT22.
 	}
 }
 
@@ -171,13 +220,61 @@ ISR(TIMER_CTC_VECTOR){
  * 
  * The external interrupt is used to measure the width of a pulse and change
  * the state accordingly.
+ *
+ * The data bit path (state DHT_TRANSFERING) is tested first, it runs 40 times
+ * per reading while the other states run once. The data bit edges are >= 78us
+ * apart and the UART interrupts share the CPU, so keep it short: no loops and
+ * no variable shifts here. Worst case and UART margin in DHT22int.h, measure
+ * it with prof.h after a change.
+ * Profiled like the timer handler.
  */
+#if (PROF_ENABLE == 1)
+static inline void edge_handler(void) __attribute__((always_inline));
 ISR(EXT_INTERRUPT_VECTOR){
+	PROF_BEGIN(PROF_EDGE);
+	edge_handler();
+	PROF_END(PROF_EDGE);
+}
+static inline void edge_handler(void)
+#else
+ISR(EXT_INTERRUPT_VECTOR)
+#endif
+{
 	
-	uint8_t counter_us;
-	counter_us = TIMER_COUNTER_REGISTER; // Store counter value
+	uint8_t counter_us; // Pulse width in ticks.
+	uint8_t byte_done;
+	EXT_INTERRUPT_EDGE_FILTER // Only the PCINT backend: ignore the other edge.
+	EXT_INTERRUPT_READ_WIDTH(counter_us) // Store counter value
 	TIMER_COUNTER_REGISTER = 0; // Reset counter.
 	
+	/* Period P5. Measuring the with of the pulse in order to determine if it is a 0 or a 1.
+	   Bit 0 has a period of 50us + 28us, bit 1 has a period of 50us + 70us. Pulses outside
+	   of (50us, 160us] are ignored. Bit is 1 if larger than bit_threshold (110us nominal).
+	   (DHT22 timing is no precise, neither the timer) */
+	if (state == DHT_TRANSFERING){
+		DHT22_HIST_ADD(DHT_HIST_DATA, counter_us);
+		if ((uint8_t)(counter_us - (DHT22_US(50) + 1)) > (DHT22_US(160) - DHT22_US(50) - 1)){ // Same as (counter_us <= 50us || counter_us > 160us), one compare.
+			return;
+		}
+		byte_done = shift_reg & 0x80; // Marker is about to leave: 8th bit of the byte.
+		shift_reg <<= 1;
+		if (counter_us > bit_threshold){ // Sensor sent a databit 1.
+			shift_reg |= 1;
+		}
+		if (byte_done){
+			frame[frame_idx++] = shift_reg;
+			shift_reg = 1;
+			/* Check if all bits arrived. If so, stop the timer and external interrupt. */
+			if (frame_idx == sizeof(frame)){ // Transfer done
+				TIMER_STOP // Stop timer.
+				TIMER_COUNTER_REGISTER = 0; // Reset counter.
+				EXT_INTERRUPT_DISABLE // Disabling interrupt
+				SET_PIN_OUTPUT(DHT22_DDR,pin_mask);
+				PIN_HIGH(DHT22_PORT,pin_mask);
+				state = DHT_CHECK_CRC; // Change state.
+			}
+		}
+	}
 	/* Period P3. Sensor pulls down the line for aprox. 80us.
 	   The ext int. was configured to rising edge. If counter is aprox. 80,
 	   (or  < 100 in this case) when the line rises it
@@ -185,57 +282,34 @@ ISR(EXT_INTERRUPT_VECTOR){
 	   Now we have to change interrupt sense to falling edge in order to
 	   detect the period P4.
 	 */
-	if ((state == DHT_WAIT_SENSOR_RESPONSE && (counter_us > 60) && counter_us < 100)){ // Sensor responded (Period P3).
-		EXT_INTERRUPT_DISABLE  // Disabling interrupt.
-		EXT_INTERRUPT_SET_FALLING_EDGE  // Changing interrupt sense to falling edge.
-		EXT_INTERRUPT_CLEAR_FLAG  // clearing flag (this prevents interrupt to fire when changing to falling edge).
-		EXT_INTERRUPT_ENABLE  // Re-enabling interrupt.
-		state = DHT_SENSOR_PULLUP; // Changing state.
-		return;
+	else if (state == DHT_WAIT_SENSOR_RESPONSE){
+		DHT22_HIST_ADD(DHT_HIST_ACK_LOW, counter_us);
+		if ((counter_us > DHT22_US(60)) && (counter_us < DHT22_US(100))){ // Sensor responded (Period P3).
+			EXT_INTERRUPT_DISABLE  // Disabling interrupt.
+			EXT_INTERRUPT_SET_FALLING_EDGE  // Changing interrupt sense to falling edge.
+			EXT_INTERRUPT_CLEAR_FLAG  // clearing flag (this prevents interrupt to fire when changing to falling edge).
+			EXT_INTERRUPT_ENABLE  // Re-enabling interrupt.
+			ack_low_us = counter_us;
+			state = DHT_SENSOR_PULLUP; // Changing state.
+		}
 	}
 	/* Period P4. When the falling edge interrupt occurs, indicating the end of P4,
 	   we get the counter register and check it value. If it is less than 100 (period
 	   P4 is also aprox. 80us) then the sensor responded pulling up the line. Now the 
 	   bit transmission will start and we only need to measure the with of each bit. So,
 	   the external interrupt can stay on falling edge. */
-	else if((state == DHT_SENSOR_PULLUP) && (counter_us > 60) && (counter_us < 100)){ // Sensor responded (Period P4).
-		state = DHT_TRANSFERING; // Change state
-		return;
-	}
-	/* Period P5. Measuring the with of the pulse in order to determine if it is a 0 or a 1.
-	   Bit 0 has a period of 50us + 28us. So we check if it is larger than 50us and smaller than 110. (DHT22 timing is no precise, neither the timer) */
-	else if((state == DHT_TRANSFERING) && (counter_us > 50) && (counter_us <= 110)){ // Sensor sent a databit 0 (Period P5).
-		// If bit is a 0, only increment the bit counter (we need only to shift 1's).
-		bitcounter++; 
-	}
-	/* Period P5. Bit 1 has a period of 50us + 70us. So, we check if it is lager than 50us and smaller than 160. */
-	else if((state == DHT_TRANSFERING) && (counter_us > 110) && (counter_us <= 160)){ // Sensor sent a databit 1 (Period P5).
-		/* If bit is one, we shift one to the variables rawHumidity, rawTemperature and checkSum according
-		   with bit position givem by bitcounter */
-		if (bitcounter < 16) // Humidity
-		{
-			rawHumidity |= (1 << (15 - bitcounter));
+	else if (state == DHT_SENSOR_PULLUP){
+		DHT22_HIST_ADD(DHT_HIST_ACK_HIGH, counter_us);
+		if ((counter_us > DHT22_US(60)) && (counter_us < DHT22_US(100))){ // Sensor responded (Period P4).
+#if (DHT22_ADAPTIVE_THRESHOLD == 1)
+			/* Scale the bit threshold from the ACK timing. Done once per reading,
+			   so the data bit path only compares against bit_threshold. */
+			bit_threshold = ((uint16_t)(ack_low_us + counter_us) * 11) >> 4;
+			if (bit_threshold < DHT22_BIT_THRESHOLD_MIN) bit_threshold = DHT22_BIT_THRESHOLD_MIN;
+			if (bit_threshold > DHT22_BIT_THRESHOLD_MAX) bit_threshold = DHT22_BIT_THRESHOLD_MAX;
+#endif
+			state = DHT_TRANSFERING; // Change state
 		}
-		if ((bitcounter > 15) && (bitcounter < 32))  // Temperature
-		{
-			rawTemperature |= (1 << (31 - bitcounter));
-		}
-		if ((bitcounter > 31) && (bitcounter < 40))  // CRC data
-		{
-			checkSum |= (1 << (39 - bitcounter));
-		}
-		bitcounter++; // Increments bit counter, the state does not change. 
-	}
-	
-	/* Check if all bits arrived. If so, stop the timer and external interrupt. */
-	if (bitcounter > 39){ // Transfer done
-		TIMER_STOP // Stop timer.
-		TIMER_COUNTER_REGISTER = 0; // Reset counter.
-		EXT_INTERRUPT_DISABLE // Disabling interrupt
-		SET_PIN_OUTPUT(DHT22_DDR,DHT22_PIN);
-		PIN_HIGH(DHT22_PORT,DHT22_PIN);
-		bitcounter = 0; // Reset bit counter.
-		state = DHT_CHECK_CRC; // Change state.
 	}
 	
 	/* CRC check is done at outside interrupt handler, by the
@@ -244,65 +318,51 @@ ISR(EXT_INTERRUPT_VECTOR){
 }
 
 /*
- * DHT22_STATE_t DHT22_CheckStatus(DHT22_DATA_t* data)
+ * DHT22_STATUS_t DHT22_CheckStatus(DHT22_DATA_t* data)
  *
  * Function that should be called after DHT22_StartReading() in order to check
  * if a transfer is complete.
  *
- * It returns a DHT22_STATE_t variable with the state of the state machine.
+ * It returns a DHT22_STATUS_t variable with the state of the reading.
  *  Returned values:
+ *    DHT_BUSY: Reading in progress.
  *    DHT_DATA_READY: Data is ok and can be used by the main program.
  *    DHT_ERROR_CHECKSUM: Error, checksum does no match.
- *    DHT_ERROR_NOT_RESPOND: Sensor is not connected or not responding for some reason.
+ *    DHT_BUS_HUNG: The line was still low when the sensor response timed out.
+ *    DHT_ERROR_NOT_PRESENT, DHT_ERROR_ACK_TOO_LONG, DHT_ERROR_DATA_TIMEOUT:
+ *        Sensor is not connected or not responding for some reason.
+ *    DHT_STOPPED: No reading was started.
  */
 
-DHT22_STATE_t DHT22_CheckStatus(DHT22_DATA_t* data){
+DHT22_STATUS_t DHT22_CheckStatus(DHT22_DATA_t* data){
 	
 	/* If a transfer is complete, check CRC and update sensor data structure */
 	if (state == DHT_CHECK_CRC){
-		
-		// calculate checksum:
-		csPart1 = rawHumidity >> 8;
-		csPart2 = rawHumidity & 0xFF;
-		csPart3 = rawTemperature >> 8;
-		csPart4 = rawTemperature & 0xFF;
-		
-		if( checkSum == ( (csPart1 + csPart2 + csPart3 + csPart4) & 0xFF ) ){ // Checksum correct
-			
-			/* raw data to sensor values */
-			data->humidity_integral = (uint8_t)(rawHumidity / 10);
-			data->humidity_decimal = (uint8_t)(rawHumidity % 10);			
-			if(rawTemperature & 0x8000)	// Check if temperature is below zero, non standard way of encoding negative numbers!
-			{
-				rawTemperature &= 0x7FFF; // Remove signal bit
-				data->temperature_integral = (int8_t)(rawTemperature / 10) * -1;
-				data->temperature_decimal = (uint8_t)(rawTemperature % 10);
-			} else
-			{
-				data->temperature_integral = (int8_t)(rawTemperature / 10);
-				data->temperature_decimal = (uint8_t)(rawTemperature % 10);
-			}
-			state = DHT_DATA_READY;
-		}
-		else{
-			state = DHT_ERROR_CHECKSUM;
-		}
+		status = DHT22_DecodeFrame(frame, data);
+		state = DHT_DONE;
 	}
 	
-	return state;
+	if (state == DHT_DONE || state == DHT_IDLE){
+		return status;
+	}
+	return DHT_BUSY;
 }
 
 /*
  * void DHT22_Init(void)
  *
  * Function to be called before the main loop.
- * It configures the sensor pin and timer mode.
+ * It configures the sensor pins and timer mode.
  */
 void DHT22_Init(void){
 	
-	/* Configuring DHT pin as output (initially) */
-	DHT22_DDR |= (1 << DHT22_PIN);
-	PIN_HIGH(DHT22_PORT,DHT22_PIN);
+	uint8_t i;
+	
+	/* Configuring DHT pins as output (initially) */
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		SET_PIN_OUTPUT(DHT22_DDR,1 << dht22_pins[i]);
+		PIN_HIGH(DHT22_PORT,1 << dht22_pins[i]);
+	}
 	
 	/* Timer config. */
 	TIMER_SETUP_CTC  // Seting timer to CTC
@@ -310,45 +370,48 @@ void DHT22_Init(void){
 	// Timer is started by the function DHT22_StartReading. For now
 	// it remains with prescaler = 0 (disable).
 	TIMER_STOP
+	EXT_INTERRUPT_SETUP
 	
-	state = DHT_STOPPED;
+	status = DHT_STOPPED;
+	state = DHT_IDLE;
 	
 }
 
 /*
- * DHT22_STATE_t DHT22_StartReading(void)
+ * DHT22_STATUS_t DHT22_StartReading(uint8_t sensor)
  *
  * This function starts a new reading of the sensor.
- * It returns a variable of type DHT22_STATE_t with the possible values:
+ * It returns a variable of type DHT22_STATUS_t with the possible values:
  *    DHT_BUSY: The reading did not started because the state machine 
  *              is doing something else, indicating that the previous
  *              reading did not finished.
  *    DHT_STARTED: The state machine has successfully started. The user
  *                 can wait for data using DHT22_CheckStatus() function.
  */
-DHT22_STATE_t DHT22_StartReading(void){
+DHT22_STATUS_t DHT22_StartReading(uint8_t sensor){
 	
 	/* Check if the state machine is stopped. If so, start it. */
-	if (state == DHT_STOPPED || state == DHT_DATA_READY || state == DHT_ERROR_CHECKSUM || state == DHT_ERROR_NOT_RESPOND){
+	if (state == DHT_IDLE || state == DHT_DONE){
 		/* Reset values and counters */
-		rawTemperature = 0;
-		rawHumidity = 0;
-		checkSum = 0;
+		frame_idx = 0;
+		shift_reg = 1;
 		overflow_cnt = 0;
-		bitcounter = 0;
+		pin_mask = 1 << dht22_pins[sensor];
+		DHT22_HIST_SELECT(sensor);
 		/* Configuring peripherals */
-		//EIMSK &= ~(1 << INT0); // Disable external interrupt
 		EXT_INTERRUPT_DISABLE
-		DHT22_DDR |= (1 << DHT22_PIN); // Configuring sensor pin as output.
-		PIN_LOW(DHT22_PORT,DHT22_PIN); // Write 0 to pin. Start condition sent to sensor.
-		TIMER_OCR_REGISTER = 255; // Timer compare value equals to overflow (interrupt will fired at 255us).
+		SET_PIN_OUTPUT(DHT22_DDR,pin_mask); // Configuring sensor pin as output.
+		PIN_LOW(DHT22_PORT,pin_mask); // Write 0 to pin. Start condition sent to sensor.
+		TIMER_OCR_REGISTER = 255; // Timer compare value equals to overflow (interrupt will fired at 255 ticks).
 		TIMER_COUNTER_REGISTER = 0; // Reset counter value.
 		state = DHT_HOST_START; // Change state.
-		TIMER_START // Start timer with prescaler such that 1 tick equals 1us (freq = 1MHz).
+		TIMER_START // Start timer with prescaler such that 1 tick equals DHT22_TICK_US.
 		return DHT_STARTED; // Return value indicating that the state machine started.
 	}
 	else{
 		return DHT_BUSY; // If state machine is busy, return this value.
 	}
 	
-} // end DHT22_StartReading
\ No newline at end of file
+} // end DHT22_StartReading
+
+#endif
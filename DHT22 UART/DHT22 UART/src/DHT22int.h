@@ -31,10 +31,15 @@
  * This file is configured to the following situation:
  *    Microcontroller: ATmega328P
  *    Timer: 8bit Timer 2
- *    Pin: PD2 => INT0 pin
- *    8MHz clock from internal RC oscillator.
+ *    Pin: PD2 => INT0 pin (DHT22_BACKEND_INT)
+ *         any pin of PORTD => PCINT2 (DHT22_BACKEND_PCINT)
+ *         PB0 => ICP1 pin, Timer1 input capture (DHT22_BACKEND_ICP)
+ *    8MHz clock from internal RC oscillator (1us timer tick) or
+ *    16MHz crystal (2us timer tick).
  *    Divide by 8 fuse not programmed (clock is not divided by 8).
  *
+ * The backend, port and pins are selected at config/conf_dht.h.
+ *
  * This config should also work with ATmega48A(PA), ATmega88A(PA),
  * ATmega168A(PA) and ATmega328.
  *
@@ -45,75 +50,135 @@
 #ifndef DHT22INT_H_
 #define DHT22INT_H_
 
+#include "DHT22drv.h"
+
 /* Driver Configuration */
 #define OVERFLOWS_HOST_START 2 // How many times a timer overflow is used to generate Period P1.
-#define DHT22_DATA_BIT_COUNT 40 // Number of bits that the sensor send.
 
-/* Macros: */
-#define PIN_LOW(port,pin) port &= ~(1<<pin)
-#define PIN_HIGH(port,pin) port |= (1<<pin)
-#define SET_PIN_INPUT(portdir,pin) portdir &= ~(1<<pin)
-#define SET_PIN_OUTPUT(portdir,pin) portdir |= (1<<pin)
-#define PIN_TOGGLE(port,pin) port ^= (1<<pin)
+/* Timer tick. All the pulse widths measured by the driver are in ticks. Use
+   DHT22_US() to write a time in us. */
+#if (F_CPU == 8000000UL)
+#define DHT22_TICK_US 1
+#elif (F_CPU == 16000000UL)
+#define DHT22_TICK_US 2
+#else
+#error "DHT22int: F_CPU not supported, configure the timer prescaler."
+#endif
+#define DHT22_US(us) ((us) / DHT22_TICK_US)
+
+/* Bit decision threshold (period P5, sync + data, in us). Bit 0 is 50us + 28us and
+   bit 1 is 50us + 70us. With DHT22_ADAPTIVE_THRESHOLD equal to 1 the threshold is
+   scaled each reading from the measured ACK periods P3 + P4 (160us nominal):
+   threshold = (P3 + P4) * 11 / 16, which gives the fixed 110us for a nominal sensor.
+   P3 and P4 are only accepted between 60us and 100us (83us to 136us), the result is
+   limited to the MIN/MAX values so it stays between bit 0 (78us) and bit 1 (120us).
+   Change to 0 to use the fixed DHT22_BIT_THRESHOLD. */
+#define DHT22_ADAPTIVE_THRESHOLD 1
+#define DHT22_BIT_THRESHOLD DHT22_US(110)
+#define DHT22_BIT_THRESHOLD_MIN DHT22_US(90)
+#define DHT22_BIT_THRESHOLD_MAX DHT22_US(114)
 
-/* Pin definition (change accordingly) 
-   The pin must be a INT pin. Pin Change Interrupt is not sopported yet. */
-#define DHT22_PIN PIND2 // INT0
-#define DHT22_DDR DDRD
-#define DHT22_PORT PORTD
+/* Worst case of the external interrupt handler: the last data bit of the frame
+   (INT backend, -O1), counted on the instructions of the handler, in cycles:
+     interrupt response + vector jump                          7
+     prologue (r0, r1, SREG, r24, r25, r30, r31)              18
+     read/clear counter, state and window compares            11
+     shift the bit in, threshold compare                      15
+     byte store (frame[frame_idx++]), marker reset            17
+     last byte: stop timer, disable int., pin output high     19
+     epilogue + reti                                          23
+   about 110 cycles (7us) in total, 75 for a bit that does not end a byte.
+   The PCINT and ICP backends add about 10 (edge filter, capture register).
+   The handlers do not nest, so a UART RX interrupt can wait that long. The
+   USART holds 2 received characters plus the one being shifted in, so it
+   overruns if the RX handler is late by 2 character times (10 bits):
+     9600 baud: 2083us (33333 cycles)    250000 baud: 80us (1280 cycles)
+     57600 baud: 347us (5556 cycles)     500000 baud: 40us (640 cycles)
+                                         1000000 baud: 20us (320 cycles)
+   At 1000000 baud the handler takes a third of that margin, which the timer,
+   clock and UART handlers share. The count is not checked by the build: check
+   the listing (.lss) and the PROF_EDGE maximum (prof.h) after a change. */
+
+/* Macros (pin is a bit mask): */
+#define PIN_LOW(port,mask) port &= ~(mask)
+#define PIN_HIGH(port,mask) port |= (mask)
+#define SET_PIN_INPUT(portdir,mask) portdir &= ~(mask)
+#define SET_PIN_OUTPUT(portdir,mask) portdir |= (mask)
+#define PIN_TOGGLE(port,mask) port ^= (mask)
 
 /* User define macros. Please change this macros accordingly with the microcontroller,
    pin, the timer and also the external interrupt that you are using.
    
    IMPORTANT: You must configure the timer with a prescaler such that the tick
-              is 1us, this means a timer clock freq. of 1MHz. With 8MHz clock, you
-			  can set the prescaler to divide by 8. */
+              is DHT22_TICK_US. With 8MHz clock, you can set the prescaler to
+			  divide by 8 (1us), with 16MHz, divide by 32 (2us). */
 #define TIMER_SETUP_CTC					TCCR2A = (1 << WGM21);   // Code to configure the timer in CTC mode.
 #define TIMER_ENABLE_CTC_INTERRUPT		TIMSK2 = (1 << OCIE2A);  // Code to enable Compare Match Interrupt
 #define TIMER_OCR_REGISTER				OCR2A			// Timer output compare register.
 #define TIMER_COUNTER_REGISTER			TCNT2			// Timer counter register
+#if (DHT22_TICK_US == 1)
 #define TIMER_START						TCCR2B = (1 << CS21); // Code to start timer with 1MHz clock
+#else
+#define TIMER_START						TCCR2B = (1 << CS21) | (1 << CS20); // Code to start timer with 500kHz clock
+#endif
 #define TIMER_STOP						TCCR2B = 0; // Code to stop the timer by writing 0 in prescaler bits.
+
+/* Interrupt vectors. Change accordingly */
+#define TIMER_CTC_VECTOR				TIMER2_COMPA_vect
+
+/* Edge interrupt of each backend.
+   EXT_INTERRUPT_READ_WIDTH reads the timer ticks since the previous edge and
+   EXT_INTERRUPT_RESTART_WIDTH restarts the measurement (the timer counter is
+   also reset, it is used for the timeouts). */
+#if (DHT22_BACKEND == DHT22_BACKEND_INT)
+
+#define EXT_INTERRUPT_SETUP
 #define EXT_INTERRUPT_DISABLE			EIMSK &= ~(1 << INT0); // Code to disable the external interrupt used.
 #define EXT_INTERRUPT_ENABLE			EIMSK |= (1 << INT0);  // Code to enable the external interrupt used.
 #define EXT_INTERRUPT_SET_RISING_EDGE	EICRA |= (1 << ISC01) | (1 << ISC00); // Code to set the interrupt to rising edge
 #define EXT_INTERRUPT_SET_FALLING_EDGE	EICRA |= (1 << ISC01); EICRA &= ~(1 << ISC00);  // Code to set the interrupt to falling edge
 #define EXT_INTERRUPT_CLEAR_FLAG		EIFR |= (1 << INTF0);  // Code to clear the external interrupt flag.
-
-/* Interrupt vectors. Change accordingly */
-#define TIMER_CTC_VECTOR				TIMER2_COMPA_vect
+#define EXT_INTERRUPT_EDGE_FILTER
+#define EXT_INTERRUPT_READ_WIDTH(w)		w = TIMER_COUNTER_REGISTER;
+#define EXT_INTERRUPT_RESTART_WIDTH
 #define EXT_INTERRUPT_VECTOR			INT0_vect
 
-/* Typedef of a enumeration of the possible states and error status */
-typedef enum
-{
-	DHT_STOPPED = 0,
-	DHT_HOST_START,
-	DHT_HOST_PULLUP,
-	DHT_WAIT_SENSOR_RESPONSE,
-	DHT_SENSOR_PULLUP,
-	DHT_TRANSFERING,
-	DHT_CHECK_CRC,
-	DHT_DATA_READY,
-	DHT_ERROR_NOT_RESPOND,
-	DHT_ERROR_CHECKSUM,
-	DHT_BUSY,
-	DHT_STARTED,
-} DHT22_STATE_t;
-
-/* Typedef of the structure that holds the sensor values */
-typedef struct
-{
-	int8_t temperature_integral;
-	uint8_t temperature_decimal;
-	uint8_t humidity_integral;
-	uint8_t humidity_decimal;
-} DHT22_DATA_t;
-
-/* Function prototypes */
-void DHT22_Init(void);
-DHT22_STATE_t DHT22_StartReading(void);
-DHT22_STATE_t DHT22_CheckStatus(DHT22_DATA_t* data);
-
-
-#endif /* DHT22INT_H_ */
\ No newline at end of file
+#elif (DHT22_BACKEND == DHT22_BACKEND_PCINT)
+
+/* Pin change interrupt fires at both edges. The handler returns at once if the
+   pin level does not match the selected edge (edge_level). */
+#define EXT_INTERRUPT_SETUP				PCICR |= (1 << PCIE2);
+#define EXT_INTERRUPT_DISABLE			PCMSK2 &= ~pin_mask;
+#define EXT_INTERRUPT_ENABLE			PCMSK2 |= pin_mask;
+#define EXT_INTERRUPT_SET_RISING_EDGE	edge_level = pin_mask;
+#define EXT_INTERRUPT_SET_FALLING_EDGE	edge_level = 0;
+#define EXT_INTERRUPT_CLEAR_FLAG		PCIFR = (1 << PCIF2);
+#define EXT_INTERRUPT_EDGE_FILTER		if ((DHT22_PORT_IN & pin_mask) != edge_level) return;
+#define EXT_INTERRUPT_READ_WIDTH(w)		w = TIMER_COUNTER_REGISTER;
+#define EXT_INTERRUPT_RESTART_WIDTH
+#define EXT_INTERRUPT_VECTOR			PCINT2_vect
+
+#elif (DHT22_BACKEND == DHT22_BACKEND_ICP)
+
+/* Timer1 runs free at clk/8 and captures the edges in hardware (ICR1), so the
+   widths do not depend on the interrupt latency. Timer 2 is still used for the
+   host start and the timeouts. */
+#if (DHT22_TICK_US == 1)
+#define ICP_TICK_SHIFT 0 // Timer1 at 1MHz
+#else
+#define ICP_TICK_SHIFT 2 // Timer1 at 2MHz, 4 counts per 2us tick.
+#endif
+#define EXT_INTERRUPT_SETUP				TCCR1A = 0; TCCR1B = (1 << CS11);
+#define EXT_INTERRUPT_DISABLE			TIMSK1 &= ~(1 << ICIE1);
+#define EXT_INTERRUPT_ENABLE			TIMSK1 |= (1 << ICIE1);
+#define EXT_INTERRUPT_SET_RISING_EDGE	TCCR1B |= (1 << ICES1);
+#define EXT_INTERRUPT_SET_FALLING_EDGE	TCCR1B &= ~(1 << ICES1);
+#define EXT_INTERRUPT_CLEAR_FLAG		TIFR1 = (1 << ICF1);
+#define EXT_INTERRUPT_EDGE_FILTER
+#define EXT_INTERRUPT_READ_WIDTH(w)		{ uint16_t t = ICR1; w = (uint8_t)((t - icp_last) >> ICP_TICK_SHIFT); icp_last = t; }
+#define EXT_INTERRUPT_RESTART_WIDTH		icp_last = TCNT1;
+#define EXT_INTERRUPT_VECTOR			TIMER1_CAPT_vect
+
+#endif
+
+#endif /* DHT22INT_H_ */
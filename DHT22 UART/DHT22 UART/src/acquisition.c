@@ -0,0 +1,295 @@
+/*
+ * acquisition.c
+ *
+ * Acquisition layer: schedules the readings of the sensors, retries the
+ * failed ones and keeps statistics per error class. See acquisition.h.
+ */
+
+#include <string.h>
+#include <util/atomic.h>
+
+#include "acquisition.h"
+
+#define ACQ_NONE 0xFF // No reading in progress.
+
+#if (DHT22_POWER_CONTROL == 1)
+#define ACQ_POWERED(sensor) (power[sensor] == ACQ_POWER_ON)
+#else
+#define ACQ_POWERED(sensor) 1
+#endif
+
+ACQ_CONFIG_t acq_config;
+ACQ_STATS_t acq_stats[DHT22_SENSOR_COUNT];
+
+static uint16_t wait[DHT22_SENSOR_COUNT]; // Ticks until the next reading of each sensor.
+static uint8_t retries[DHT22_SENSOR_COUNT]; // Retries of the current sample.
+static uint8_t current = ACQ_NONE; // Sensor being read.
+static uint8_t next_sensor; // First sensor to consider for the next reading (round robin).
+static uint16_t health_wait;
+
+#if (DHT22_POWER_CONTROL == 1)
+/* Power state of each sensor */
+enum
+{
+	ACQ_POWER_ON = 0,
+	ACQ_POWER_OFF, // Waiting wait[] ticks (and the stagger) to power up.
+	ACQ_POWER_WARMUP, // Powered, waiting wait[] ticks to be read.
+};
+
+static const uint8_t power_pins[DHT22_SENSOR_COUNT] = DHT22_POWER_PINS;
+static uint8_t power[DHT22_SENSOR_COUNT];
+static uint16_t stagger_wait; // Ticks until the next power-up is allowed.
+
+/* Cuts the supply of a sensor and of the sensors that share its power pin.
+   The data pins are driven low, so the sensors are not powered through them.
+   None of them may be in a reading. The DHT22 handlers write the same port,
+   so the port and DDR changes are atomic. */
+static void power_off(uint8_t sensor)
+{
+	uint8_t i;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		DHT22_POWER_PORT &= ~(1 << power_pins[sensor]);
+	}
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		if (power_pins[i] == power_pins[sensor]){
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+				DHT22_PORT &= ~(1 << dht22_pins[i]);
+				DHT22_DDR |= (1 << dht22_pins[i]);
+			}
+			power[i] = ACQ_POWER_OFF;
+			wait[i] = ACQ_MS_TO_TICKS(ACQ_POWER_OFF_MS);
+		}
+	}
+}
+
+/* Restores the supply and the idle (high) data line of a sensor and of the
+   sensors that share its power pin. */
+static void power_on(uint8_t sensor)
+{
+	uint8_t i;
+	
+	ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+		DHT22_POWER_PORT |= (1 << power_pins[sensor]);
+	}
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		if (power_pins[i] == power_pins[sensor]){
+			ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+				DHT22_PORT |= (1 << dht22_pins[i]);
+			}
+			power[i] = ACQ_POWER_WARMUP;
+			wait[i] = ACQ_MS_TO_TICKS(DHT22_WARMUP_MS);
+		}
+	}
+	stagger_wait = ACQ_MS_TO_TICKS(ACQ_POWER_STAGGER_MS);
+}
+
+/* Power state machine, called every tick. Sensors are powered up one at a time. */
+static void power_tick(void)
+{
+	uint8_t i;
+	
+	if (stagger_wait) stagger_wait--;
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		if (wait[i] != 0) continue;
+		if (power[i] == ACQ_POWER_OFF && stagger_wait == 0){
+			power_on(i);
+		}
+		else if (power[i] == ACQ_POWER_WARMUP){
+			power[i] = ACQ_POWER_ON;
+		}
+	}
+}
+#endif
+
+static void count(uint16_t* counter)
+{
+	if (*counter != 0xFFFF) (*counter)++;
+}
+
+/* Ticks until the next sample of a sensor: the sample period, never shorter
+   than the sensor's minimum interval. */
+static uint16_t period_ticks(void)
+{
+	uint16_t period = acq_config.period_ms;
+	
+	if (period < DHT22_MIN_INTERVAL_MS) period = DHT22_MIN_INTERVAL_MS;
+	return ACQ_MS_TO_TICKS(period);
+}
+
+/*
+ * Handles the result of a reading: schedules the next reading (or a retry)
+ * and updates the statistics.
+ */
+static void result(uint8_t sensor, DHT22_STATUS_t status, const DHT22_DATA_t* data)
+{
+	ACQ_STATS_t* stats = &acq_stats[sensor];
+	
+	if (status == DHT_DATA_READY){
+		count(&stats->ok);
+		retries[sensor] = 0;
+		wait[sensor] = period_ticks();
+		ACQ_OnSample(sensor, data);
+		return;
+	}
+	
+	if (status <= DHT_ERROR_CHECKSUM){
+		count(&stats->err[status]);
+	}
+#if (DHT22_POWER_CONTROL == 1)
+	/* The line is stuck low: power cycle the sensor, the retry (or the next
+	   sample) is read after the warm-up. */
+	if (status == DHT_BUS_HUNG){
+		count(&stats->power_cycles);
+		power_off(sensor);
+		if (retries[sensor] < ACQ_MAX_RETRIES){
+			retries[sensor]++;
+			count(&stats->retries);
+		}
+		else{
+			retries[sensor] = 0;
+			count(&stats->lost);
+			ACQ_OnError(sensor, status);
+		}
+		return;
+	}
+#endif
+	if (retries[sensor] < ACQ_MAX_RETRIES){
+		/* Retry after the sensor's minimum interval, doubled at each retry. */
+		wait[sensor] = ACQ_MS_TO_TICKS(DHT22_MIN_INTERVAL_MS) << retries[sensor];
+		retries[sensor]++;
+		count(&stats->retries);
+	}
+	else{
+		retries[sensor] = 0;
+		wait[sensor] = period_ticks();
+		count(&stats->lost);
+		ACQ_OnError(sensor, status);
+	}
+}
+
+/*
+ * Starts the reading of the first sensor that is due, from next_sensor on so
+ * that sensors due at the same time are read in turn. skip is the sensor
+ * whose result is not handled yet (its next reading is not scheduled).
+ */
+static void start_next(uint8_t skip)
+{
+	uint8_t n, i;
+	
+	for (n = 0; n < DHT22_SENSOR_COUNT; n++){
+		i = next_sensor + n;
+		if (i >= DHT22_SENSOR_COUNT) i -= DHT22_SENSOR_COUNT;
+		if (i != skip && (acq_config.enabled & (1 << i)) && (wait[i] == 0) && ACQ_POWERED(i)){
+			if (DHT22_StartReading(i) == DHT_STARTED){
+				current = i;
+				next_sensor = (i + 1 < DHT22_SENSOR_COUNT) ? i + 1 : 0;
+			}
+			return;
+		}
+	}
+}
+
+/* Polls the reading in progress. Returns its sensor if it ended, ACQ_NONE otherwise. */
+static uint8_t poll(DHT22_STATUS_t* status, DHT22_DATA_t* data)
+{
+	uint8_t sensor = current;
+	
+	*status = DHT22_CheckStatus(data);
+	if (*status == DHT_BUSY) return ACQ_NONE;
+	current = ACQ_NONE;
+	return sensor;
+}
+
+/*
+ * void ACQ_Init(void)
+ *
+ * Initializes the driver and the acquisition layer. All sensors are enabled.
+ */
+void ACQ_Init(void)
+{
+#if (DHT22_POWER_CONTROL == 1)
+	uint8_t i;
+#endif
+
+	DHT22_Init();
+	acq_config.period_ms = ACQ_PERIOD_MS;
+	acq_config.enabled = (uint8_t)((1 << DHT22_SENSOR_COUNT) - 1);
+	memset(wait, 0, sizeof(wait));
+	memset(retries, 0, sizeof(retries));
+	current = ACQ_NONE;
+	next_sensor = 0;
+	health_wait = ACQ_MS_TO_TICKS(ACQ_HEALTH_PERIOD_MS);
+	ACQ_ClearStats();
+#if (DHT22_POWER_CONTROL == 1)
+	/* Start with all sensors off, power_tick() powers them up staggered. */
+	stagger_wait = 0;
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		ATOMIC_BLOCK(ATOMIC_RESTORESTATE){
+			DHT22_POWER_DDR |= (1 << power_pins[i]);
+		}
+		power_off(i);
+		wait[i] = 0;
+	}
+#endif
+}
+
+void ACQ_ClearStats(void)
+{
+	memset(acq_stats, 0, sizeof(acq_stats));
+}
+
+/*
+ * void ACQ_Tick(void)
+ *
+ * Must be called every ACQ_TICK_MS. With the blocking backend a reading
+ * is done inside this function (almost 6ms in the worst case).
+ */
+void ACQ_Tick(void)
+{
+	DHT22_DATA_t data;
+	DHT22_STATUS_t status = DHT_BUSY;
+	uint8_t done = ACQ_NONE;
+	uint8_t i;
+	
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		if (wait[i]) wait[i]--;
+	}
+#if (DHT22_POWER_CONTROL == 1)
+	power_tick();
+#endif
+	
+	/* Pipeline: collect the reading that ended, start the next one at once,
+	   then hand the result to the application. With the interrupt backends
+	   the next transaction runs while the result is formatted and queued for
+	   transmission, so the bus is not idle for a tick between sensors. */
+	if (current != ACQ_NONE){
+		done = poll(&status, &data);
+	}
+#if (DHT22_POWER_CONTROL == 1)
+	/* Except for a power cycle: it cuts the sensors that share the power pin,
+	   so it is done before one of them could be started. */
+	if (done != ACQ_NONE && status == DHT_BUS_HUNG){
+		result(done, status, &data);
+		done = ACQ_NONE;
+	}
+#endif
+	if (current == ACQ_NONE){
+		start_next(done);
+		if (done == ACQ_NONE && current != ACQ_NONE){
+			done = poll(&status, &data); // Blocking backend: already done.
+		}
+	}
+	if (done != ACQ_NONE){
+		result(done, status, &data);
+	}
+	
+#if (ACQ_HEALTH_PERIOD_MS > 0)
+	if (--health_wait == 0){
+		health_wait = ACQ_MS_TO_TICKS(ACQ_HEALTH_PERIOD_MS);
+		for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+			ACQ_OnHealth(i, &acq_stats[i]);
+		}
+	}
+#endif
+}
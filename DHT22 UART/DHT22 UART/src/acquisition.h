@@ -0,0 +1,89 @@
+/*
+ * acquisition.h
+ *
+ * Acquisition layer: schedules the readings of the sensors, retries the
+ * failed ones and keeps statistics per error class.
+ *
+ * ACQ_Tick() must be called every ACQ_TICK_MS. It starts the readings when
+ * they are due (one sensor at a time, the driver reads one sensor at a time,
+ * in turn when several are due), polls the driver and calls the application
+ * back:
+ *   ACQ_OnSample(): a reading succeeded.
+ *   ACQ_OnError():  a reading failed and all the retries failed too.
+ *   ACQ_OnHealth(): periodic health record of each sensor.
+ *
+ * The readings are pipelined: in the tick a reading ends, the next due
+ * sensor is started before the result is handed to the application, so with
+ * the interrupt backends a transaction is on the bus while the previous
+ * result is formatted and sent (the UART transmits from its interrupt too).
+ * With N sensors due, one sample per tick is read instead of one every two
+ * ticks. The blocking backend reads inside DHT22_StartReading() and cannot
+ * overlap.
+ *
+ * A failed reading is retried after the sensor's minimum interval
+ * (DHT22_MIN_INTERVAL_MS), doubling the wait at each retry (backoff), up to
+ * ACQ_MAX_RETRIES. So a single noisy reading costs a delay, not a sample.
+ *
+ * With DHT22_POWER_CONTROL (config/conf_dht.h) a sensor that hangs the bus
+ * (DHT_BUS_HUNG: the line is low before the start with the blocking backend,
+ * or when the response times out with the interrupt backends) is power
+ * cycled: its supply is cut for ACQ_POWER_OFF_MS,
+ * restored, and it is read again after the datasheet warm-up
+ * (DHT22_WARMUP_MS). Power-ups are staggered by ACQ_POWER_STAGGER_MS, so
+ * sensors that share one supply do not start together. At start-up all
+ * sensors are powered up the same way.
+ */
+
+#ifndef ACQUISITION_H_
+#define ACQUISITION_H_
+
+#include "DHT22drv.h"
+
+#if (DHT22_SENSOR_COUNT > 8)
+#error "acquisition: at most 8 sensors (acq_config.enabled is a uint8_t mask)."
+#endif
+
+#define ACQ_TICK_MS 10 // Period of ACQ_Tick().
+#define ACQ_MS_TO_TICKS(ms) ((uint16_t)((ms) / ACQ_TICK_MS))
+
+#define DHT22_MIN_INTERVAL_MS 2000 // Sensor's minimum interval between readings (datasheet).
+#define ACQ_PERIOD_MS 2000 // Default sample period of each sensor.
+#define ACQ_MIN_PERIOD_MS DHT22_MIN_INTERVAL_MS // Minimum sample period accepted from the host (a shorter one is read at this period).
+#define ACQ_MAX_RETRIES 3 // Retries of a failed reading before reporting the error.
+#define ACQ_HEALTH_PERIOD_MS 60000 // Period of the health records (0 disables).
+
+#define ACQ_POWER_OFF_MS 1000 // Time without supply to reset a sensor.
+#define DHT22_WARMUP_MS 2000 // Sensor's warm-up after power-up (datasheet: > 1s).
+#define ACQ_POWER_STAGGER_MS 500 // Minimum time between two power-ups.
+
+/* Statistics of a sensor. err[] is indexed by DHT22_STATUS_t (err[0] is not used,
+   ok counts the successful readings). Counters saturate at 0xFFFF. */
+typedef struct
+{
+	uint16_t ok;
+	uint16_t err[DHT_ERROR_CHECKSUM + 1];
+	uint16_t retries; // Retried readings.
+	uint16_t lost; // Samples lost (all retries failed).
+	uint16_t power_cycles; // Power cycles after DHT_BUS_HUNG.
+} ACQ_STATS_t;
+
+/* Configuration */
+typedef struct
+{
+	uint16_t period_ms; // Sample period of each sensor.
+	uint8_t enabled; // Bit n enables sensor n.
+} ACQ_CONFIG_t;
+
+extern ACQ_CONFIG_t acq_config;
+extern ACQ_STATS_t acq_stats[DHT22_SENSOR_COUNT];
+
+void ACQ_Init(void);
+void ACQ_Tick(void);
+void ACQ_ClearStats(void);
+
+/* Application callbacks */
+void ACQ_OnSample(uint8_t sensor, const DHT22_DATA_t* data);
+void ACQ_OnError(uint8_t sensor, DHT22_STATUS_t error);
+void ACQ_OnHealth(uint8_t sensor, const ACQ_STATS_t* stats);
+
+#endif /* ACQUISITION_H_ */
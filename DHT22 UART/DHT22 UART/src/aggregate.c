@@ -0,0 +1,57 @@
+/*
+ * aggregate.c
+ *
+ * Aggregation of the samples over an interval. See aggregate.h.
+ */
+
+#include <string.h>
+
+#include "aggregate.h"
+
+static AGG_t agg[DHT22_SENSOR_COUNT];
+
+void AGG_Add(uint8_t sensor, const DHT22_DATA_t* data)
+{
+	AGG_t* a = &agg[sensor];
+	
+	if (a->count == 0xFFFF) return;
+	if (a->count == 0 || data->raw_temperature < a->temperature_min) a->temperature_min = data->raw_temperature;
+	if (a->count == 0 || data->raw_temperature > a->temperature_max) a->temperature_max = data->raw_temperature;
+	if (a->count == 0 || data->raw_humidity < a->humidity_min) a->humidity_min = data->raw_humidity;
+	if (a->count == 0 || data->raw_humidity > a->humidity_max) a->humidity_max = data->raw_humidity;
+	a->temperature_sum += data->raw_temperature;
+	a->humidity_sum += data->raw_humidity;
+	a->count++;
+}
+
+void AGG_Error(uint8_t sensor)
+{
+	if (agg[sensor].errors < 0xFFFF) agg[sensor].errors++;
+}
+
+const AGG_t* AGG_Get(uint8_t sensor)
+{
+	return &agg[sensor];
+}
+
+/* Mean temperature in 0.01 C, rounded (0 without samples). */
+int16_t AGG_TemperatureMean(const AGG_t* a)
+{
+	int32_t sum = a->temperature_sum * 10;
+	
+	if (a->count == 0) return 0;
+	sum += (sum < 0) ? -(int32_t)(a->count / 2) : (int32_t)(a->count / 2);
+	return sum / a->count;
+}
+
+/* Mean humidity in 0.01 %, rounded (0 without samples). */
+uint16_t AGG_HumidityMean(const AGG_t* a)
+{
+	if (a->count == 0) return 0;
+	return (a->humidity_sum * 10 + a->count / 2) / a->count;
+}
+
+void AGG_Clear(uint8_t sensor)
+{
+	memset(&agg[sensor], 0, sizeof(AGG_t));
+}
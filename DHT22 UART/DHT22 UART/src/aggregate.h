@@ -0,0 +1,38 @@
+/*
+ * aggregate.h
+ *
+ * Aggregation of the samples of each sensor over an interval: count,
+ * errors, minimum, maximum and mean of the temperature and the humidity.
+ * The mean is computed with one more decimal than the samples (0.01 C,
+ * 0.01 %), oversampling improves its resolution. See report.h for the
+ * output of the records.
+ */
+
+#ifndef AGGREGATE_H_
+#define AGGREGATE_H_
+
+#include <stdint.h>
+
+#include "DHT22drv.h"
+
+/* Accumulator of a sensor */
+typedef struct
+{
+	uint16_t count; // Samples
+	uint16_t errors;
+	int16_t temperature_min; // 0.1 C
+	int16_t temperature_max;
+	int32_t temperature_sum;
+	uint16_t humidity_min; // 0.1 %
+	uint16_t humidity_max;
+	uint32_t humidity_sum;
+} AGG_t;
+
+void AGG_Add(uint8_t sensor, const DHT22_DATA_t* data);
+void AGG_Error(uint8_t sensor);
+const AGG_t* AGG_Get(uint8_t sensor);
+int16_t AGG_TemperatureMean(const AGG_t* agg);
+uint16_t AGG_HumidityMean(const AGG_t* agg);
+void AGG_Clear(uint8_t sensor);
+
+#endif /* AGGREGATE_H_ */
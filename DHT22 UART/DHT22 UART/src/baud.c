@@ -0,0 +1,132 @@
+/*
+ * baud.c
+ *
+ * Baud rate selection. See baud.h.
+ */
+
+#include <avr/io.h>
+#include <util/delay.h>
+
+#include "acquisition.h"
+#include "baud.h"
+#include "uart.h"
+
+/* Two characters at the start-up rate (the slowest one used). */
+#define BAUD_DRAIN_MS ((22000UL + USART_BAUDRATE - 1) / USART_BAUDRATE + 1)
+
+typedef struct
+{
+	uint32_t rate;
+	uint16_t setting;
+} BAUD_RATE_t;
+
+/* Rates the host can select, those F_CPU generates within the tolerance */
+static const BAUD_RATE_t rates[] =
+{
+#if BAUD_OK(9600)
+	{ 9600, BAUD_SETTING(9600) },
+#endif
+#if BAUD_OK(19200)
+	{ 19200, BAUD_SETTING(19200) },
+#endif
+#if BAUD_OK(38400)
+	{ 38400, BAUD_SETTING(38400) },
+#endif
+#if BAUD_OK(57600)
+	{ 57600, BAUD_SETTING(57600) },
+#endif
+#if BAUD_OK(115200)
+	{ 115200, BAUD_SETTING(115200) },
+#endif
+#if BAUD_OK(230400)
+	{ 230400, BAUD_SETTING(230400) },
+#endif
+#if BAUD_OK(250000)
+	{ 250000, BAUD_SETTING(250000) },
+#endif
+#if BAUD_OK(500000)
+	{ 500000, BAUD_SETTING(500000) },
+#endif
+#if BAUD_OK(1000000)
+	{ 1000000, BAUD_SETTING(1000000) },
+#endif
+	{ USART_BAUDRATE, BAUD_SETTING(USART_BAUDRATE) },
+};
+
+static uint8_t pending; // Switched, waiting for a command at the new rate.
+static uint16_t wait;
+
+/*
+ * uint16_t BAUD_Lookup(uint32_t rate)
+ *
+ * Returns the setting of a supported rate, BAUD_NONE if the rate is not
+ * supported or is below USART_BAUDRATE.
+ */
+uint16_t BAUD_Lookup(uint32_t rate)
+{
+	uint8_t i;
+	
+	if (rate < USART_BAUDRATE) return BAUD_NONE;
+	for (i = 0; i < sizeof(rates) / sizeof(rates[0]); i++){
+		if (rates[i].rate == rate) return rates[i].setting;
+	}
+	return BAUD_NONE;
+}
+
+/*
+ * uint8_t BAUD_Rates(uint32_t* list)
+ *
+ * Writes the supported rates (those BAUD_Lookup() accepts), lowest first,
+ * and returns how many. list must hold BAUD_MAX_RATES.
+ */
+uint8_t BAUD_Rates(uint32_t* list)
+{
+	uint8_t i, n = 0;
+	
+	for (i = 0; i < sizeof(rates) / sizeof(rates[0]) - 1; i++){ // The last one is USART_BAUDRATE again
+		if (rates[i].rate >= USART_BAUDRATE) list[n++] = rates[i].rate;
+	}
+	return n;
+}
+
+/*
+ * void BAUD_Set(uint16_t setting)
+ *
+ * Waits until the queued bytes are sent and changes the rate.
+ */
+void BAUD_Set(uint16_t setting)
+{
+	while (UCSR0B & (1 << UDRIE0)); // TX buffer empty (uart.c)
+	while (!(UCSR0A & (1 << UDRE0))); // Last byte in the shift register
+	_delay_ms(BAUD_DRAIN_MS);
+	uart_init(setting);
+}
+
+/*
+ * void BAUD_Switch(uint16_t setting)
+ *
+ * Changes the rate after a CMD_SET_BAUD. If no command is received at the
+ * new rate within BAUD_CONFIRM_MS (BAUD_Confirm), goes back to USART_BAUDRATE,
+ * so a host that could not follow does not lose the device.
+ */
+void BAUD_Switch(uint16_t setting)
+{
+	BAUD_Set(setting);
+	pending = 1;
+	wait = ACQ_MS_TO_TICKS(BAUD_CONFIRM_MS);
+}
+
+/* Called for each valid command received. */
+void BAUD_Confirm(void)
+{
+	pending = 0;
+}
+
+/* Must be called every ACQ_TICK_MS. */
+void BAUD_Tick(void)
+{
+	if (pending && --wait == 0){
+		pending = 0;
+		BAUD_Set(BAUD_SETTING(USART_BAUDRATE));
+	}
+}
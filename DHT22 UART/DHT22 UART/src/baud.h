@@ -0,0 +1,64 @@
+/*
+ * baud.h
+ *
+ * Baud rate settings computed at compile time, with the baud rate error
+ * checked against UART_BAUD_TOLERANCE (config/conf_uart.h), and the rates
+ * the host can switch to (CMD_SET_BAUD, command.h).
+ *
+ * BAUD_SETTING(rate) is the value for uart_init(): the UBRR value of the
+ * mode (normal or double speed, U2X) with the lowest error, with bit 15 set
+ * for double speed. Normal speed is preferred on a tie, as it samples each
+ * bit more times. Everything is evaluated by the preprocessor (F_CPU and
+ * rate must be integer constants).
+ *
+ * Supported rates (BAUD_RATES) at 16 MHz: 9600 to 57600, 250000, 500000 and
+ * 1000000 baud. 115200 is 2.1 % off at 16 MHz and is left out; with a
+ * 14.7456 MHz crystal all the standard rates are exact.
+ */
+
+#ifndef BAUD_H_
+#define BAUD_H_
+
+#include <stdint.h>
+
+#include "DHT22drv.h"
+#include "conf_uart.h"
+
+/* UBRR values, rounded to the nearest */
+#define BAUD_UBRR_1X(rate) ((F_CPU + 8UL * (rate)) / (16UL * (rate)) - 1)
+#define BAUD_UBRR_2X(rate) ((F_CPU + 4UL * (rate)) / (8UL * (rate)) - 1)
+
+/* Actual baud rates */
+#define BAUD_ACTUAL_1X(rate) (F_CPU / (16UL * (BAUD_UBRR_1X(rate) + 1)))
+#define BAUD_ACTUAL_2X(rate) (F_CPU / (8UL * (BAUD_UBRR_2X(rate) + 1)))
+
+/* Errors, in 0.1 % */
+#define BAUD_DIFF(a, b) (((a) > (b)) ? ((a) - (b)) : ((b) - (a)))
+#define BAUD_ERROR_1X(rate) \
+	((BAUD_UBRR_1X(rate) > 4095) ? 1000 : BAUD_DIFF(BAUD_ACTUAL_1X(rate), (rate)) * 1000 / (rate))
+#define BAUD_ERROR_2X(rate) \
+	((BAUD_UBRR_2X(rate) > 4095) ? 1000 : BAUD_DIFF(BAUD_ACTUAL_2X(rate), (rate)) * 1000 / (rate))
+
+#define BAUD_USE_2X(rate) (BAUD_ERROR_2X(rate) < BAUD_ERROR_1X(rate))
+#define BAUD_ERROR(rate) (BAUD_USE_2X(rate) ? BAUD_ERROR_2X(rate) : BAUD_ERROR_1X(rate))
+#define BAUD_SETTING(rate) \
+	(BAUD_USE_2X(rate) ? (BAUD_UBRR_2X(rate) | 0x8000) : BAUD_UBRR_1X(rate))
+
+#define BAUD_OK(rate) (BAUD_ERROR(rate) <= UART_BAUD_TOLERANCE)
+
+#if !BAUD_OK(USART_BAUDRATE)
+#error "USART_BAUDRATE cannot be generated from F_CPU within UART_BAUD_TOLERANCE (config/conf_uart.h)."
+#endif
+
+#define BAUD_NONE 0xFFFF // Not a supported rate.
+#define BAUD_CONFIRM_MS 1000 // Time to receive a command at the new rate before reverting.
+#define BAUD_MAX_RATES 9 // Rates of the table at baud.c.
+
+uint16_t BAUD_Lookup(uint32_t rate);
+uint8_t BAUD_Rates(uint32_t* list);
+void BAUD_Set(uint16_t setting);
+void BAUD_Switch(uint16_t setting);
+void BAUD_Confirm(void);
+void BAUD_Tick(void);
+
+#endif /* BAUD_H_ */
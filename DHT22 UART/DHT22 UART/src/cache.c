@@ -0,0 +1,55 @@
+/*
+ * cache.c
+ *
+ * Cache of the last samples. See cache.h.
+ */
+
+#include <stddef.h>
+
+#include "cache.h"
+
+static CACHE_RECORD_t records[CACHE_SIZE];
+static uint8_t head; // Next record to write.
+static uint8_t count;
+static uint16_t next_seq;
+
+/*
+ * void CACHE_Add(uint8_t sensor, DHT22_STATUS_t status, const DHT22_DATA_t* data)
+ *
+ * Stores a result, overwriting the oldest record when the cache is full.
+ * data is only read when status is DHT_DATA_READY.
+ */
+void CACHE_Add(uint8_t sensor, DHT22_STATUS_t status, const DHT22_DATA_t* data)
+{
+	CACHE_RECORD_t* r = &records[head];
+	
+	r->seq = next_seq++;
+	r->sensor = sensor;
+	r->status = status;
+	if (status == DHT_DATA_READY){
+		r->raw_temperature = data->raw_temperature;
+		r->raw_humidity = data->raw_humidity;
+	}
+	else{
+		r->raw_temperature = 0;
+		r->raw_humidity = 0;
+	}
+	head = (head + 1) % CACHE_SIZE;
+	if (count < CACHE_SIZE) count++;
+}
+
+uint8_t CACHE_Count(void)
+{
+	return count;
+}
+
+/*
+ * const CACHE_RECORD_t* CACHE_Get(uint8_t age)
+ *
+ * Returns a record by age (0 is the newest), NULL if age >= CACHE_Count().
+ */
+const CACHE_RECORD_t* CACHE_Get(uint8_t age)
+{
+	if (age >= count) return NULL;
+	return &records[(head + CACHE_SIZE - 1 - age) % CACHE_SIZE];
+}
@@ -0,0 +1,36 @@
+/*
+ * cache.h
+ *
+ * Cache of the last samples, for the poll mode (see report.h). Every result
+ * of the acquisition (sample or error) is stored with a sequence number, so
+ * the host can ask for the last sample of a sensor, the last N records or
+ * the records after the last one it has seen. A jump in the sequence
+ * numbers tells the host that records were overwritten before it read them.
+ *
+ * Only used from the main loop, no interrupt protection is needed.
+ */
+
+#ifndef CACHE_H_
+#define CACHE_H_
+
+#include <stdint.h>
+
+#include "DHT22drv.h"
+
+#define CACHE_SIZE 16 // Records kept (8 bytes each).
+
+/* Record. status is DHT_DATA_READY for a sample; for an error the values are 0. */
+typedef struct
+{
+	uint16_t seq;
+	uint8_t sensor;
+	uint8_t status; // DHT22_STATUS_t
+	int16_t raw_temperature;
+	uint16_t raw_humidity;
+} CACHE_RECORD_t;
+
+void CACHE_Add(uint8_t sensor, DHT22_STATUS_t status, const DHT22_DATA_t* data);
+uint8_t CACHE_Count(void);
+const CACHE_RECORD_t* CACHE_Get(uint8_t age);
+
+#endif /* CACHE_H_ */
@@ -0,0 +1,128 @@
+/*
+ * clock.c
+ *
+ * Device uptime clock. See clock.h.
+ */
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <avr/sleep.h>
+
+#include "clock.h"
+
+static volatile uint32_t clock_ms; // Milliseconds at the last overflow.
+static volatile uint16_t clock_us; // and the microseconds beyond them.
+static volatile uint8_t clock_ovf; // Overflow count (CLOCK_Count()).
+
+static uint32_t next_tick; // Deadline of CLOCK_WaitTick().
+static uint32_t asleep_ms;
+static uint16_t asleep_us; // and the microseconds beyond them.
+
+ISR(TIMER0_OVF_vect)
+{
+	uint32_t ms = clock_ms + CLOCK_OVF_US / 1000;
+	uint16_t us = clock_us + CLOCK_OVF_US % 1000;
+	
+	if (us >= 1000){
+		us -= 1000;
+		ms++;
+	}
+	clock_ms = ms;
+	clock_us = us;
+	clock_ovf++;
+}
+
+/* Compare match: only wakes the CPU up at the deadline of CLOCK_WaitTick(). */
+EMPTY_INTERRUPT(TIMER0_COMPA_vect)
+
+/* Returns the timer ticks (CLOCK_TICK_NS), 16 bit. Interrupts must be disabled. */
+static uint16_t count(void)
+{
+	uint8_t ovf = clock_ovf;
+	uint8_t count = TCNT0;
+	
+	if ((TIFR0 & (1 << TOV0)) && count < 255) ovf++;
+	return ((uint16_t)ovf << 8) | count;
+}
+
+void CLOCK_Init(void)
+{
+	TCCR0A = 0; // Normal mode
+	TCNT0 = 0;
+	TIMSK0 = (1 << TOIE0) | (1 << OCIE0A);
+	TCCR0B = (1 << CS02) | (1 << CS00); // clk/1024
+}
+
+/*
+ * uint32_t CLOCK_Millis(void)
+ *
+ * Returns the milliseconds since CLOCK_Init(). Can be called with the
+ * interrupts disabled: an overflow not serviced yet is counted.
+ */
+uint32_t CLOCK_Millis(void)
+{
+	uint8_t sreg = SREG;
+	uint32_t ms, us;
+	uint8_t count;
+	
+	cli();
+	ms = clock_ms;
+	us = clock_us;
+	count = TCNT0;
+	if ((TIFR0 & (1 << TOV0)) && count < 255){
+		us += CLOCK_OVF_US; // Overflow pending
+	}
+	SREG = sreg;
+	
+	us += (uint32_t)count * CLOCK_TICK_NS / 1000;
+	return ms + us / 1000;
+}
+
+/*
+ * void CLOCK_WaitTick(uint16_t period_ms)
+ *
+ * Waits for the next tick of period period_ms (from the previous one, so the
+ * time spent in the main loop does not stretch the period) in idle sleep.
+ * Any interrupt wakes the CPU up (UART, sensor edges, timers); the timer
+ * compare match wakes it up at the deadline. A late tick is not caught up.
+ */
+void CLOCK_WaitTick(uint16_t period_ms)
+{
+	uint32_t left;
+	uint16_t start;
+	
+	next_tick += period_ms;
+	if ((int32_t)(CLOCK_Millis() - next_tick) > 0) next_tick = CLOCK_Millis();
+	
+	set_sleep_mode(SLEEP_MODE_IDLE);
+	while (1){
+		cli();
+		left = next_tick - CLOCK_Millis();
+		if ((int32_t)left <= 0) break;
+		// Wake up at the deadline, or at the end of the timer cycle at most.
+		left = (left < 256) ? left * 1000000UL / CLOCK_TICK_NS : 255;
+		OCR0A = TCNT0 + ((left < 255) ? left : 255);
+		start = count();
+		sleep_enable();
+		sei(); // The next instruction is executed before any interrupt.
+		sleep_cpu();
+		sleep_disable();
+		cli();
+		asleep_us += (uint16_t)(count() - start) * (CLOCK_TICK_NS / 1000);
+		sei();
+		asleep_ms += asleep_us / 1000;
+		asleep_us %= 1000;
+	}
+	sei();
+}
+
+/*
+ * uint32_t CLOCK_Asleep(void)
+ *
+ * Returns the milliseconds spent in sleep since CLOCK_Init(). The time awake
+ * is CLOCK_Millis() minus this.
+ */
+uint32_t CLOCK_Asleep(void)
+{
+	return asleep_ms;
+}
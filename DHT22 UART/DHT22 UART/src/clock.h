@@ -0,0 +1,41 @@
+/*
+ * clock.h
+ *
+ * Device uptime clock in milliseconds, used to timestamp the samples and to
+ * synchronize with the host (CMD_TIME_SYNC, command.h).
+ *
+ * Timer0 runs free with the /1024 prescaler and counts its overflows
+ * (CLOCK_OVF_US, 16.384 ms at 16 MHz). The overflow period is longer than
+ * the time the blocking backend keeps the interrupts disabled (almost 6ms),
+ * so no overflow is lost. CLOCK_Millis() adds the timer count, so the
+ * resolution is one timer tick (64 us at 16 MHz). The clock wraps after
+ * about 49 days; the host unwraps it.
+ *
+ * CLOCK_WaitTick() paces the main loop: the CPU sleeps in idle mode until
+ * the next tick, woken up by the timer compare match or any other interrupt
+ * (UART RX and TX, sensor edges, DHT22 timer). Idle is the deepest mode that
+ * keeps Timer0 and the UART running; power-save would stop both (only the
+ * asynchronous Timer2 runs in it, and the driver uses it). The time spent
+ * asleep is counted (CLOCK_Asleep()) and sent in the health records.
+ *
+ * The clock runs from the crystal: its drift (typically below 100 ppm) is
+ * estimated by the host from the synchronizations.
+ */
+
+#ifndef CLOCK_H_
+#define CLOCK_H_
+
+#include <stdint.h>
+
+#include "DHT22drv.h"
+
+#define CLOCK_PRESCALER 1024UL
+#define CLOCK_TICK_NS (1000000000UL / (F_CPU / CLOCK_PRESCALER)) // Timer tick (ns).
+#define CLOCK_OVF_US (256UL * CLOCK_TICK_NS / 1000) // Overflow period (us).
+
+void CLOCK_Init(void);
+uint32_t CLOCK_Millis(void);
+void CLOCK_WaitTick(uint16_t period_ms);
+uint32_t CLOCK_Asleep(void);
+
+#endif /* CLOCK_H_ */
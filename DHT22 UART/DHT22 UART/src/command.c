@@ -0,0 +1,429 @@
+/*
+ * command.c
+ *
+ * Command interface over the UART RX. See command.h.
+ */
+
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+
+#include "acquisition.h"
+#include "baud.h"
+#include "cache.h"
+#include "clock.h"
+#include "command.h"
+#include "eelog.h"
+#include "filter.h"
+#include "frame.h"
+#include "ident.h"
+#include "prof.h"
+#include "report.h"
+#include "uart.h"
+
+/* Parser states */
+enum
+{
+	CMD_WAIT_SYNC = 0,
+	CMD_WAIT_CMD,
+	CMD_WAIT_LEN,
+	CMD_WAIT_PAYLOAD,
+	CMD_WAIT_CRC_LOW,
+	CMD_WAIT_CRC_HIGH,
+};
+
+static uint8_t rx_state;
+static uint8_t rx_cmd;
+static uint8_t rx_len;
+static uint8_t rx_pos;
+static uint16_t rx_crc;
+static uint8_t rx_idle; // Polls without bytes in the middle of a command.
+static uint32_t rx_time; // Clock when the command was received (CMD_TIME_SYNC).
+static uint8_t rx_payload[CMD_MAX_PAYLOAD];
+
+static void reply(uint8_t cmd, uint8_t status)
+{
+	FRAME_Send(FRAME_REPLY | cmd, &status, 1);
+}
+
+/* Sends n records of the cache, from age oldest to the newer ones. */
+static void reply_records(uint8_t cmd, uint8_t oldest, uint8_t n)
+{
+	uint8_t payload[2 + CMD_MAX_RECORDS * sizeof(CACHE_RECORD_t)];
+	uint8_t* p = &payload[2];
+	uint8_t i;
+	
+	payload[0] = CMD_OK;
+	payload[1] = n;
+	while (n--){
+		const uint8_t* r = (const uint8_t*)CACHE_Get(oldest--);
+		for (i = 0; i < sizeof(CACHE_RECORD_t); i++){
+			*p++ = r[i];
+		}
+	}
+	FRAME_Send(FRAME_REPLY | cmd, payload, p - payload);
+}
+
+/* Sends the EEPROM log blocks after seq (all of them if all is set). */
+static void dump_log(uint8_t all, uint16_t seq)
+{
+	uint8_t payload[1 + CMD_LOG_BLOCKS * sizeof(LOG_BLOCK_t)];
+	LOG_BLOCK_t* blocks = (LOG_BLOCK_t*)&payload[1];
+	uint16_t sent = 0;
+	uint32_t now;
+	uint8_t i, n = 0;
+	
+	for (i = 0; i < LOG_BLOCKS; i++){
+		if (!LOG_Read(i, &blocks[n])) continue;
+		if (!all && (int16_t)(blocks[n].seq - seq) <= 0) continue;
+		if (++n == CMD_LOG_BLOCKS){
+			payload[0] = n;
+			FRAME_Send(FRAME_LOG, payload, 1 + n * sizeof(LOG_BLOCK_t));
+			sent += n;
+			n = 0;
+		}
+	}
+	if (n){
+		payload[0] = n;
+		FRAME_Send(FRAME_LOG, payload, 1 + n * sizeof(LOG_BLOCK_t));
+		sent += n;
+	}
+	
+	payload[0] = CMD_OK;
+	payload[1] = (uint8_t)sent;
+	payload[2] = (uint8_t)(sent >> 8);
+	payload[3] = LOG_Boot();
+	now = CLOCK_Millis();
+	for (i = 0; i < 4; i++){
+		payload[4 + i] = (uint8_t)(now >> (8 * i));
+	}
+	FRAME_Send(FRAME_REPLY | CMD_DUMP_LOG, payload, 8);
+}
+
+#if (PROF_ENABLE == 1)
+/* Sends the profiling trace, then the statistics in the reply. Each entry is
+   copied with the interrupts disabled, they keep running meanwhile. */
+static void dump_prof(void)
+{
+	uint8_t payload[1 + CMD_TRACE_ENTRIES * sizeof(PROF_TRACE_t)]; // Also holds the reply (73 bytes).
+	PROF_TRACE_t* entries = (PROF_TRACE_t*)&payload[1];
+	PROF_STATS_t* stats = (PROF_STATS_t*)&payload[3];
+	uint8_t i, n = 0, index;
+	
+	index = prof_trace_head;
+	for (i = 0; i < PROF_TRACE_SIZE; i++){
+		cli();
+		entries[n] = prof_trace[index];
+		sei();
+		index = (index + 1) & (PROF_TRACE_SIZE - 1);
+		if (entries[n].id == PROF_TRACE_EMPTY) continue;
+		if (++n == CMD_TRACE_ENTRIES){
+			payload[0] = n;
+			FRAME_Send(FRAME_TRACE, payload, 1 + n * sizeof(PROF_TRACE_t));
+			n = 0;
+		}
+	}
+	if (n){
+		payload[0] = n;
+		FRAME_Send(FRAME_TRACE, payload, 1 + n * sizeof(PROF_TRACE_t));
+	}
+	
+	payload[0] = CMD_OK;
+	payload[1] = PROF_CYCLES_PER_COUNT;
+	payload[2] = PROF_IDS;
+	for (i = 0; i < PROF_IDS; i++){
+		cli();
+		stats[i] = prof_stats[i];
+		sei();
+	}
+	FRAME_Send(FRAME_REPLY | CMD_DUMP_PROF, payload, 3 + PROF_IDS * sizeof(PROF_STATS_t));
+}
+#endif
+
+/* Sends the identity of the device (CMD_IDENTIFY). */
+static void identify(void)
+{
+	uint8_t payload[10 + 4 * BAUD_MAX_RATES];
+	uint32_t rates[BAUD_MAX_RATES];
+	uint32_t id = IDENT_Get();
+	uint8_t i, n;
+	
+	payload[0] = CMD_OK;
+	for (i = 0; i < 4; i++){
+		payload[1 + i] = (uint8_t)(id >> (8 * i));
+	}
+	payload[5] = IDENT_VERSION_MAJOR;
+	payload[6] = IDENT_VERSION_MINOR;
+	payload[7] = DHT22_SENSOR_COUNT;
+	payload[8] = (1 << REPORT_ASCII) | (1 << REPORT_BINARY) | (1 << REPORT_DELTA);
+	n = BAUD_Rates(rates);
+	payload[9] = n;
+	for (i = 0; i < 4 * n; i++){
+		payload[10 + i] = (uint8_t)(rates[i / 4] >> (8 * (i % 4)));
+	}
+	FRAME_Send(FRAME_REPLY | CMD_IDENTIFY, payload, 10 + 4 * n);
+}
+
+/* Executes a received command and sends the reply. */
+static void execute(uint8_t cmd, const uint8_t* p, uint8_t len)
+{
+	uint16_t period, seq, setting, heartbeat, alpha;
+	uint8_t i, n;
+	
+	switch (cmd){
+		case CMD_SET_PERIOD:
+			if (len != 2) break;
+			period = p[0] | ((uint16_t)p[1] << 8);
+			if (period < ACQ_MIN_PERIOD_MS) break;
+			acq_config.period_ms = period;
+			reply(cmd, CMD_OK);
+			return;
+			
+		case CMD_SET_FORMAT:
+			if (len != 1 || p[0] > REPORT_DELTA) break;
+			report_format = p[0];
+			reply(cmd, CMD_OK);
+			return;
+			
+		case CMD_ENABLE_SENSORS:
+			if (len != 1 || (p[0] >> DHT22_SENSOR_COUNT)) break;
+			acq_config.enabled = p[0];
+			reply(cmd, CMD_OK);
+			return;
+			
+		case CMD_DUMP_STATS:
+			if (len != 1 || p[0] >= DHT22_SENSOR_COUNT) break;
+			{
+				uint8_t payload[2 + sizeof(ACQ_STATS_t)];
+				payload[0] = CMD_OK;
+				payload[1] = p[0];
+				for (i = 0; i < sizeof(ACQ_STATS_t); i++){
+					payload[2 + i] = ((const uint8_t*)&acq_stats[p[0]])[i];
+				}
+				FRAME_Send(FRAME_REPLY | cmd, payload, sizeof(payload));
+			}
+			return;
+			
+		case CMD_RESET_COUNTERS:
+			if (len != 0) break;
+			ACQ_ClearStats();
+			reply(cmd, CMD_OK);
+			return;
+			
+#if (DHT22_HISTOGRAM == 1)
+		case CMD_DUMP_HIST:
+			if (len != 0) break;
+			reply(cmd, CMD_OK);
+			REPORT_Histograms();
+			return;
+			
+		case CMD_CLEAR_HIST:
+			if (len != 0) break;
+			cli();
+			DHT22_HistClear();
+			sei();
+			reply(cmd, CMD_OK);
+			return;
+#endif
+			
+		case CMD_SET_MODE:
+			if (len != 1 || p[0] > REPORT_POLL) break;
+			report_mode = p[0];
+			reply(cmd, CMD_OK);
+			return;
+			
+		case CMD_READ_LAST:
+			if (len != 1 || p[0] >= DHT22_SENSOR_COUNT) break;
+			for (i = 0; i < CACHE_Count() && CACHE_Get(i)->sensor != p[0]; i++);
+			reply_records(cmd, i, (i < CACHE_Count()) ? 1 : 0);
+			return;
+			
+		case CMD_READ_LAST_N:
+			if (len != 1 || p[0] == 0 || p[0] > CMD_MAX_RECORDS) break;
+			n = (p[0] < CACHE_Count()) ? p[0] : CACHE_Count();
+			reply_records(cmd, n - 1, n);
+			return;
+			
+		case CMD_READ_SINCE:
+			if (len != 2) break;
+			seq = p[0] | ((uint16_t)p[1] << 8);
+			// Records newer than seq (the sequence numbers wrap around).
+			for (i = 0; i < CACHE_Count() && (int16_t)(CACHE_Get(i)->seq - seq) > 0; i++);
+			n = (i < CMD_MAX_RECORDS) ? i : CMD_MAX_RECORDS;
+			reply_records(cmd, i - 1, n);
+			return;
+			
+		case CMD_SET_BAUD:
+			if (len != 4 || p[3]) break;
+			setting = BAUD_Lookup(p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16));
+			if (setting == BAUD_NONE) break;
+			reply(cmd, CMD_OK);
+			BAUD_Switch(setting);
+			return;
+			
+		case CMD_SET_DEADBAND:
+			if (len != 6) break;
+			heartbeat = p[4] | ((uint16_t)p[5] << 8);
+			if (heartbeat > REPORT_MAX_HEARTBEAT_S) break;
+			report_deadband.temperature = p[0] | ((uint16_t)p[1] << 8);
+			report_deadband.humidity = p[2] | ((uint16_t)p[3] << 8);
+			report_deadband.heartbeat_s = heartbeat;
+			reply(cmd, CMD_OK);
+			return;
+			
+		case CMD_SET_FILTER:
+			if (len != 3 || !(p[0] & 1) || p[0] > FILTER_MAX_MEDIAN) break;
+			alpha = p[1] | ((uint16_t)p[2] << 8);
+			if (alpha == 0 || alpha > FILTER_ALPHA_ONE) break;
+			filter_config.median = p[0];
+			filter_config.alpha = alpha;
+			FILTER_Reset();
+			reply(cmd, CMD_OK);
+			return;
+			
+		case CMD_SET_AGGREGATE:
+			if (len != 2) break;
+			period = p[0] | ((uint16_t)p[1] << 8);
+			if (period > REPORT_MAX_AGGREGATE_S) break;
+			REPORT_SetAggregate(period);
+			reply(cmd, CMD_OK);
+			return;
+			
+		case CMD_SET_BATCH:
+			if (len != 3 || p[0] > REPORT_BATCH_MAX) break;
+			period = p[1] | ((uint16_t)p[2] << 8); // Latency
+			if (period < ACQ_TICK_MS || period > REPORT_BATCH_MAX_LATENCY_MS) break;
+			report_batch.samples = p[0];
+			report_batch.latency_ms = period;
+			reply(cmd, CMD_OK);
+			return;
+			
+		case CMD_DUMP_LOG:
+			if (len != 0 && len != 2) break;
+			dump_log(len == 0, p[0] | ((uint16_t)p[1] << 8));
+			return;
+			
+		case CMD_TIME_SYNC:
+			if (len != 4) break;
+			{
+				uint8_t payload[13];
+				uint32_t now;
+				payload[0] = CMD_OK;
+				for (i = 0; i < 4; i++){
+					payload[1 + i] = p[i]; // Host time, echoed
+					payload[5 + i] = (uint8_t)(rx_time >> (8 * i));
+				}
+				now = CLOCK_Millis();
+				for (i = 0; i < 4; i++){
+					payload[9 + i] = (uint8_t)(now >> (8 * i));
+				}
+				FRAME_Send(FRAME_REPLY | cmd, payload, sizeof(payload));
+			}
+			return;
+			
+		case CMD_NACK:
+			if (len != 2 || p[1] == 0 || p[1] > FRAME_WINDOW_FRAMES) break;
+			{
+				uint8_t payload[2];
+				payload[0] = CMD_OK;
+				payload[1] = 0;
+				for (i = 0; i < p[1]; i++){
+					payload[1] += FRAME_Resend(p[0] + i);
+				}
+				FRAME_Send(FRAME_REPLY | cmd, payload, sizeof(payload));
+			}
+			return;
+			
+#if (PROF_ENABLE == 1)
+		case CMD_DUMP_PROF:
+			if (len != 0) break;
+			dump_prof();
+			return;
+			
+		case CMD_CLEAR_PROF:
+			if (len != 0) break;
+			PROF_Clear();
+			reply(cmd, CMD_OK);
+			return;
+#endif
+			
+		case CMD_IDENTIFY:
+			if (len != 0) break;
+			identify();
+			return;
+			
+		case CMD_SET_ID:
+			if (len != 4) break;
+			IDENT_Set(p[0] | ((uint32_t)p[1] << 8) | ((uint32_t)p[2] << 16) | ((uint32_t)p[3] << 24));
+			reply(cmd, CMD_OK);
+			return;
+			
+		default:
+			reply(cmd, CMD_ERR_UNKNOWN);
+			return;
+	}
+	reply(cmd, CMD_ERR_ARG);
+}
+
+void CMD_Init(void)
+{
+	rx_state = CMD_WAIT_SYNC;
+}
+
+/*
+ * void CMD_Poll(void)
+ *
+ * Reads the received bytes (does not block) and executes the complete
+ * commands. Must be called every ACQ_TICK_MS.
+ */
+void CMD_Poll(void)
+{
+	unsigned int c;
+	uint8_t data;
+	
+	if (rx_state != CMD_WAIT_SYNC && ++rx_idle > ACQ_MS_TO_TICKS(CMD_TIMEOUT_MS)){
+		rx_state = CMD_WAIT_SYNC; // Partial command timed out.
+	}
+	
+	while (!((c = uart_getc()) & UART_NO_DATA)){
+		data = (uint8_t)c;
+		rx_idle = 0;
+		if (c & (UART_FRAME_ERROR | UART_OVERRUN_ERROR | UART_PARITY_ERROR | UART_BUFFER_OVERFLOW)){
+			rx_state = CMD_WAIT_SYNC; // Bytes lost, drop the command.
+			continue;
+		}
+		switch (rx_state){
+			case CMD_WAIT_SYNC:
+				if (data == CMD_SYNC) rx_state = CMD_WAIT_CMD;
+				break;
+			case CMD_WAIT_CMD:
+				rx_cmd = data;
+				rx_crc = _crc16_update(0xFFFF, data);
+				rx_state = CMD_WAIT_LEN;
+				break;
+			case CMD_WAIT_LEN:
+				rx_len = data;
+				rx_crc = _crc16_update(rx_crc, data);
+				rx_pos = 0;
+				if (rx_len > CMD_MAX_PAYLOAD) rx_state = CMD_WAIT_SYNC;
+				else rx_state = (rx_len) ? CMD_WAIT_PAYLOAD : CMD_WAIT_CRC_LOW;
+				break;
+			case CMD_WAIT_PAYLOAD:
+				rx_payload[rx_pos++] = data;
+				rx_crc = _crc16_update(rx_crc, data);
+				if (rx_pos == rx_len) rx_state = CMD_WAIT_CRC_LOW;
+				break;
+			case CMD_WAIT_CRC_LOW:
+				rx_crc = _crc16_update(rx_crc, data);
+				rx_state = CMD_WAIT_CRC_HIGH;
+				break;
+			case CMD_WAIT_CRC_HIGH:
+				rx_state = CMD_WAIT_SYNC;
+				if (_crc16_update(rx_crc, data) == 0){
+					rx_time = CLOCK_Millis();
+					BAUD_Confirm();
+					execute(rx_cmd, rx_payload, rx_len);
+				}
+				break;
+		}
+	}
+}
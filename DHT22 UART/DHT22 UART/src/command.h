@@ -0,0 +1,131 @@
+/*
+ * command.h
+ *
+ * Command interface over the UART RX (see frame.h for the framing).
+ *
+ * CMD_Poll() must be called periodically from the main loop. It reads the
+ * bytes received by the UART interrupt (uart.c ring buffer) without
+ * blocking, assembles the command frames and executes them. Each command
+ * is answered with a FRAME_REPLY | cmd frame, whose payload starts with a
+ * status byte (CMD_OK, CMD_ERR_ARG or CMD_ERR_UNKNOWN).
+ *
+ * Commands (payload):
+ *   CMD_SET_PERIOD      uint16 period (ms)         Sample period (>= ACQ_MIN_PERIOD_MS).
+ *   CMD_SET_FORMAT      uint8 format               REPORT_ASCII, REPORT_BINARY or REPORT_DELTA.
+ *   CMD_ENABLE_SENSORS  uint8 mask                 Bit n enables sensor n.
+ *   CMD_DUMP_STATS      uint8 sensor               Reply: status, sensor, ACQ_STATS_t.
+ *   CMD_RESET_COUNTERS  -                          Clears the statistics.
+ *   CMD_DUMP_HIST       -                          Sends the histograms (DHT22_HISTOGRAM).
+ *   CMD_CLEAR_HIST      -                          Clears the histograms (DHT22_HISTOGRAM).
+ *   CMD_SET_MODE        uint8 mode                 REPORT_STREAM or REPORT_POLL.
+ *   CMD_READ_LAST       uint8 sensor               Last record of a sensor.
+ *   CMD_READ_LAST_N     uint8 n                    Last n records (1 to CMD_MAX_RECORDS).
+ *   CMD_READ_SINCE      uint16 seq                 Records after seq, oldest first.
+ *   CMD_DUMP_LOG        [uint16 seq]               EEPROM log blocks after seq (all if no payload).
+ *   CMD_SET_BAUD        uint32 rate                Baud rate (see baud.h).
+ *   CMD_SET_DEADBAND    uint16 temperature (0.1 C), uint16 humidity (0.1 %),
+ *                       uint16 heartbeat (s)       Report by exception (report.h), heartbeat 0 disables.
+ *   CMD_SET_FILTER      uint8 median, uint16 alpha Sample filter (filter.h).
+ *   CMD_SET_AGGREGATE   uint16 interval (s)        Aggregation (report.h), 0 disables.
+ *   CMD_SET_BATCH       uint8 samples, uint16 latency (ms)
+ *                                                  Batching (report.h), samples 0 or 1 disables.
+ *   CMD_TIME_SYNC       uint32 host time           Reply: status, host time, uint32 receive time,
+ *                                                  uint32 transmit time (ms, clock.h).
+ *   CMD_NACK            uint8 seq, uint8 count     Sends again the numbered frames seq to seq + count - 1
+ *                                                  (frame.h), count 1 to FRAME_WINDOW_FRAMES.
+ *   CMD_DUMP_PROF       -                          Sends the profiling trace and statistics (PROF_ENABLE).
+ *   CMD_CLEAR_PROF      -                          Clears them (PROF_ENABLE).
+ *   CMD_IDENTIFY        -                          Reply: status, uint32 id, uint8 version major, minor,
+ *                                                  uint8 sensors, uint8 formats (bit n: format n),
+ *                                                  uint8 n, n x uint32 baud rate (ident.h, baud.h).
+ *   CMD_SET_ID          uint32 id                  Device id, kept in the EEPROM (ident.h).
+ *
+ * The CMD_READ_xxx replies are: status, count, count x CACHE_RECORD_t (cache.h),
+ * oldest first. CMD_READ_SINCE returns at most CMD_MAX_RECORDS records, the
+ * host asks again from the last sequence number until count is 0. If seq is
+ * older than the cache, the reply starts from the oldest record.
+ *
+ * CMD_DUMP_LOG sends the blocks of the EEPROM log (eelog.h), oldest first, in
+ * FRAME_LOG frames of up to CMD_LOG_BLOCKS blocks, then the reply: status,
+ * uint16 blocks sent, uint8 reset counter and uint32 time (CLOCK_Millis()),
+ * to date the blocks (eelog.h). The last block of each sensor can still grow, so the
+ * host asks again from before the oldest block with count below
+ * LOG_SAMPLES_PER_BLOCK and replaces the blocks it has by seq.
+ *
+ * CMD_SET_BAUD is answered at the current rate, then the device switches.
+ * The host switches too and sends any command at the new rate within
+ * BAUD_CONFIRM_MS (CMD_DUMP_STATS for instance); otherwise the device goes
+ * back to USART_BAUDRATE. A rate that is not supported is answered with
+ * CMD_ERR_ARG.
+ *
+ * CMD_TIME_SYNC is one exchange of an NTP-like synchronization: the host
+ * notes its send time t1 (echoed) and receive time t4, the device gives the
+ * time t2 the command was received (up to one ACQ_TICK_MS after its last
+ * byte) and the time t3 the reply was queued. The host estimates the offset
+ * ((t2 - t1) + (t3 - t4)) / 2 within half the round trip
+ * (t4 - t1) - (t3 - t2), and the drift from several exchanges.
+ *
+ * CMD_NACK sends the frames still in the retransmit window, with their
+ * original sequence numbers, then the reply: status, uint8 frames sent. The
+ * frames that are not sent again are lost.
+ *
+ * CMD_DUMP_PROF sends the trace (prof.h), oldest section first, in
+ * FRAME_TRACE frames of up to CMD_TRACE_ENTRIES entries, then the reply:
+ * status, uint8 cycles per count (PROF_CYCLES_PER_COUNT), uint8 PROF_IDS,
+ * PROF_IDS x PROF_STATS_t.
+ *
+ * CMD_IDENTIFY is the first command of a host that looks for the devices:
+ * it is answered in any format and mode (at the current rate), with what
+ * the host needs to choose the port, the rate and the format. A device that
+ * answers IDENT_NONE gets an id with CMD_SET_ID.
+ *
+ * With the blocking backend the interrupts are disabled while reading the
+ * sensor (almost 6ms) and received bytes can be lost. A host that gets no
+ * reply should send the command again.
+ */
+
+#ifndef COMMAND_H_
+#define COMMAND_H_
+
+#include <stdint.h>
+
+/* Commands */
+#define CMD_SET_PERIOD 0x01
+#define CMD_SET_FORMAT 0x02
+#define CMD_ENABLE_SENSORS 0x03
+#define CMD_DUMP_STATS 0x04
+#define CMD_RESET_COUNTERS 0x05
+#define CMD_DUMP_HIST 0x06
+#define CMD_CLEAR_HIST 0x07
+#define CMD_SET_MODE 0x08
+#define CMD_READ_LAST 0x09
+#define CMD_READ_LAST_N 0x0A
+#define CMD_READ_SINCE 0x0B
+#define CMD_DUMP_LOG 0x0C
+#define CMD_SET_BAUD 0x0D
+#define CMD_SET_DEADBAND 0x0E
+#define CMD_SET_FILTER 0x0F
+#define CMD_SET_AGGREGATE 0x10
+#define CMD_SET_BATCH 0x11
+#define CMD_NACK 0x12
+#define CMD_TIME_SYNC 0x13
+#define CMD_DUMP_PROF 0x14
+#define CMD_CLEAR_PROF 0x15
+#define CMD_IDENTIFY 0x16
+#define CMD_SET_ID 0x17
+
+/* Reply status */
+#define CMD_OK 0
+#define CMD_ERR_ARG 1
+#define CMD_ERR_UNKNOWN 2
+
+#define CMD_MAX_PAYLOAD 8
+#define CMD_TIMEOUT_MS 100 // A partial command is dropped after this time without bytes.
+#define CMD_MAX_RECORDS 9 // Records per reply (FRAME_MAX_PAYLOAD).
+#define CMD_LOG_BLOCKS 2 // Log blocks per FRAME_LOG (FRAME_MAX_PAYLOAD).
+#define CMD_TRACE_ENTRIES 15 // Trace entries per FRAME_TRACE (FRAME_MAX_PAYLOAD).
+
+void CMD_Init(void);
+void CMD_Poll(void);
+
+#endif /* COMMAND_H_ */
@@ -0,0 +1,45 @@
+/*
+ * conf_dht.h
+ *
+ * DHT22 driver configuration: backend selection and sensor pins.
+ * See DHT22drv.h for the backends.
+ */
+
+#ifndef CONF_DHT_H_
+#define CONF_DHT_H_
+
+/* Backend used by DHT22_Init/DHT22_StartReading/DHT22_CheckStatus. One of:
+     DHT22_BACKEND_BUSYWAIT => DHT22.c, blocking. Any pin.
+     DHT22_BACKEND_INT      => DHT22int.c, INT0 pin (PD2). One sensor.
+     DHT22_BACKEND_PCINT    => DHT22int.c, pin change interrupt. Any pin of DHT22_PORT.
+     DHT22_BACKEND_ICP      => DHT22int.c, Timer1 input capture, ICP1 pin (PB0). One sensor. */
+#define DHT22_BACKEND DHT22_BACKEND_BUSYWAIT
+
+/* Port where the sensors are connected. All sensors must share the same port. */
+#define DHT22_DDR DDRD
+#define DHT22_PORT PORTD
+#define DHT22_PORT_IN PIND
+
+/* Number of sensors and their pins at DHT22_PORT (sensor 0 first). */
+#define DHT22_SENSOR_COUNT 1
+#define DHT22_SENSOR_PINS { PD6 }
+
+/* Optional power control of the sensors (see acquisition.h). Change to 1 if the
+   supply of each sensor is switched by a pin (high = on), so the firmware can
+   power cycle a sensor that hangs the bus. Sensors may share a pin (and supply). */
+#define DHT22_POWER_CONTROL 0
+#define DHT22_POWER_DDR DDRC
+#define DHT22_POWER_PORT PORTC
+#define DHT22_POWER_PINS { PC0 }
+
+/* Output format setting: 1 outputs a struct with the raw values
+   from DHT22 (0.1 units). The firmware works on the raw values
+   (report, filter, cache, log), so it must stay 1; 0 (decimal and
+   integral parts) is only for other users of the driver. */
+#define OUTPUT_RAW_VALUES 1
+
+/* Pulse width histograms (see DHT22hist.h). Change to 1 to accumulate
+   the width of each pulse read from the sensors. */
+#define DHT22_HISTOGRAM 0
+
+#endif /* CONF_DHT_H_ */
@@ -0,0 +1,23 @@
+/*
+ * conf_modbus.h
+ *
+ * Modbus RTU slave configuration (see modbus.h).
+ */
+
+#ifndef CONF_MODBUS_H_
+#define CONF_MODBUS_H_
+
+/* Change to 1 to answer Modbus RTU requests (RS-485 bus) instead of the
+   frame protocol (command.h). Needs an interrupt backend (DHT22_BACKEND,
+   config/conf_dht.h). */
+#define MODBUS_ENABLE 0
+
+/* Slave address of this node (1 to 247). */
+#define MODBUS_ADDRESS 1
+
+/* Driver enable pin of the RS-485 transceiver (DE and /RE tied, high = transmit). */
+#define MODBUS_DE_DDR DDRD
+#define MODBUS_DE_PORT PORTD
+#define MODBUS_DE_PIN PD4
+
+#endif /* CONF_MODBUS_H_ */
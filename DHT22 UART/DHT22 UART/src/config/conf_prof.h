@@ -0,0 +1,30 @@
+/*
+ * conf_prof.h
+ *
+ * Profiling markers configuration (see prof.h).
+ */
+
+#ifndef CONF_PROF_H_
+#define CONF_PROF_H_
+
+/* Change to 1 to measure the interrupt handlers and the main loop tasks. */
+#define PROF_ENABLE 0
+
+/* Timer1 prescaler of the cycle stamps: 1 (exact cycles, sections up to 4ms
+   at 16MHz) or 8 (8 cycle steps, up to 32ms). The ICP backend owns Timer1,
+   then it is always 8. */
+#define PROF_PRESCALER 1
+
+/* Marker pins, high while the section runs (scope or logic analyzer). Each
+   mask is a bit of PROF_PORT, 0 for no pin. */
+#define PROF_DDR DDRB
+#define PROF_PORT PORTB
+#define PROF_TIMER_MASK (1 << PB1)
+#define PROF_EDGE_MASK (1 << PB2)
+#define PROF_UART_RX_MASK (1 << PB3)
+#define PROF_UART_TX_MASK (1 << PB4)
+#define PROF_ACQ_MASK 0
+#define PROF_CMD_MASK 0
+#define PROF_REPORT_MASK 0
+
+#endif /* CONF_PROF_H_ */
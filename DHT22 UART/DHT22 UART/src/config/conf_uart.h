@@ -0,0 +1,17 @@
+/*
+ * conf_uart.h
+ *
+ * Serial link configuration (see baud.h).
+ */
+
+#ifndef CONF_UART_H_
+#define CONF_UART_H_
+
+/* Baud rate at start-up (and of the Modbus bus). The build fails if F_CPU
+   cannot generate it within UART_BAUD_TOLERANCE. */
+#define USART_BAUDRATE 9600
+
+/* Maximum baud rate error, in 0.1 % (both ends add up, 2 % is safe for 8 bit frames). */
+#define UART_BAUD_TOLERANCE 20
+
+#endif /* CONF_UART_H_ */
@@ -0,0 +1,231 @@
+/*
+ * eelog.c
+ *
+ * Store-and-forward log of the samples in the EEPROM. See eelog.h.
+ */
+
+#include <stddef.h>
+#include <avr/eeprom.h>
+
+#include "acquisition.h"
+#include "clock.h"
+#include "eelog.h"
+
+#define LOG_NONE 0xFF // No open block.
+#define LOG_BLOCK_WRITES (offsetof(LOG_BLOCK_t, delta) + 2) // Bytes queued by new_block().
+#define LOG_QUEUE_SIZE (DHT22_SENSOR_COUNT * LOG_BLOCK_WRITES)
+
+/* Byte waiting to be written */
+typedef struct
+{
+	uint8_t* address;
+	uint8_t value;
+} LOG_WRITE_t;
+
+static LOG_BLOCK_t EEMEM log_blocks[LOG_BLOCKS];
+static uint8_t EEMEM log_boot;
+
+static uint8_t head; // Next block to write (the oldest one).
+static uint16_t next_seq;
+static uint8_t open[DHT22_SENSOR_COUNT]; // Block being filled by each sensor.
+static uint8_t open_count[DHT22_SENSOR_COUNT]; // Samples in it.
+static uint8_t has_value[DHT22_SENSOR_COUNT]; // The open block has a sample (last_xxx).
+static int16_t last_temperature[DHT22_SENSOR_COUNT];
+static uint16_t last_humidity[DHT22_SENSOR_COUNT];
+static uint32_t last_time[DHT22_SENSOR_COUNT]; // Time of the last sample, as the host rebuilds it.
+static uint16_t wait[DHT22_SENSOR_COUNT]; // Ticks until the next stored sample.
+static uint8_t boot;
+
+/* An EEPROM byte write takes 3.4ms and eeprom_update_xxx() waits for each
+   one. The writes are queued instead and LOG_Tick() starts one per tick, in
+   order, when the EEPROM is ready. */
+static LOG_WRITE_t queue[LOG_QUEUE_SIZE];
+static uint8_t queue_head; // Next write started.
+static uint8_t queue_count;
+
+static void queue_byte(uint8_t* address, uint8_t value)
+{
+	uint8_t i = queue_head + queue_count;
+	
+	if (i >= LOG_QUEUE_SIZE) i -= LOG_QUEUE_SIZE;
+	queue[i].address = address;
+	queue[i].value = value;
+	queue_count++;
+}
+
+static void queue_bytes(void* address, const void* data, uint8_t len)
+{
+	uint8_t i;
+	
+	for (i = 0; i < len; i++){
+		queue_byte((uint8_t*)address + i, ((const uint8_t*)data)[i]);
+	}
+}
+
+/* Writes a new block at head (overwriting the oldest one) and opens it. */
+static void new_block(uint8_t sensor, int16_t temperature, uint16_t humidity, uint32_t time)
+{
+	LOG_BLOCK_t* block = &log_blocks[head];
+	LOG_BLOCK_t b;
+	uint8_t i;
+	
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		if (open[i] == head) open[i] = LOG_NONE;
+	}
+	
+	b.seq = next_seq++;
+	b.sensor = LOG_EMPTY;
+	b.count = 1;
+	b.boot = boot;
+	b.time = time;
+	b.raw_temperature = temperature;
+	b.raw_humidity = humidity;
+	// Invalidate, write the header, then validate (a reset in between leaves an empty block)
+	queue_byte(&block->sensor, LOG_EMPTY);
+	queue_bytes(block, &b, offsetof(LOG_BLOCK_t, delta));
+	queue_byte(&block->sensor, sensor);
+	
+	open[sensor] = head;
+	open_count[sensor] = 1;
+	last_time[sensor] = time;
+	head = (head + 1) % LOG_BLOCKS;
+}
+
+/* Seconds since the last sample of a sensor, LOG_MAX_SECONDS + 1 if more. */
+static uint16_t seconds(uint8_t sensor, uint32_t time)
+{
+	uint32_t ms = time - last_time[sensor] + 500;
+	
+	return (ms > (LOG_MAX_SECONDS + 1) * 1000UL) ? LOG_MAX_SECONDS + 1 : ms / 1000;
+}
+
+/* Adds a delta to the open block of a sensor. The count is written last. */
+static void append(uint8_t sensor, int8_t dt, int8_t dh, uint8_t s)
+{
+	LOG_BLOCK_t* block = &log_blocks[open[sensor]];
+	uint8_t n = open_count[sensor];
+	
+	queue_byte((uint8_t*)&block->delta[n - 1].temperature, dt);
+	queue_byte((uint8_t*)&block->delta[n - 1].humidity, dh);
+	queue_byte(&block->delta[n - 1].seconds, s);
+	queue_byte(&block->count, n + 1);
+	last_time[sensor] += s * 1000UL; // The rounded time, so the error does not add up.
+	
+	if (++open_count[sensor] == LOG_SAMPLES_PER_BLOCK) open[sensor] = LOG_NONE;
+}
+
+/*
+ * void LOG_Init(void)
+ *
+ * Counts the reset and finds the newest block of the log: the one whose
+ * next block is empty or does not follow it in sequence. New samples go to
+ * new blocks. Call after CLOCK_Init().
+ */
+void LOG_Init(void)
+{
+	uint8_t i, next;
+	uint16_t seq;
+	
+	boot = eeprom_read_byte(&log_boot) + 1;
+	eeprom_update_byte(&log_boot, boot);
+	head = 0;
+	next_seq = 0;
+	for (i = 0; i < LOG_BLOCKS; i++){
+		next = (i + 1) % LOG_BLOCKS;
+		if (eeprom_read_byte(&log_blocks[i].sensor) == LOG_EMPTY) continue;
+		seq = eeprom_read_word(&log_blocks[i].seq);
+		if (eeprom_read_byte(&log_blocks[next].sensor) == LOG_EMPTY ||
+				eeprom_read_word(&log_blocks[next].seq) != (uint16_t)(seq + 1)){
+			head = next;
+			next_seq = seq + 1;
+			break;
+		}
+	}
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		open[i] = LOG_NONE;
+		wait[i] = 0;
+	}
+}
+
+/* Must be called every ACQ_TICK_MS. Starts the next queued write, without waiting. */
+void LOG_Tick(void)
+{
+	uint8_t i;
+	
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		if (wait[i]) wait[i]--;
+	}
+	
+	if (queue_count && eeprom_is_ready()){
+		// Only the changed bytes are written (wear leveling).
+		if (eeprom_read_byte(queue[queue_head].address) != queue[queue_head].value){
+			eeprom_write_byte(queue[queue_head].address, queue[queue_head].value);
+		}
+		if (++queue_head == LOG_QUEUE_SIZE) queue_head = 0;
+		queue_count--;
+	}
+}
+
+/*
+ * void LOG_Add(uint8_t sensor, DHT22_STATUS_t status, const DHT22_DATA_t* data)
+ *
+ * Stores a result if the sensor's LOG_PERIOD_MS has elapsed, otherwise
+ * ignores it. data is only read when status is DHT_DATA_READY.
+ */
+void LOG_Add(uint8_t sensor, DHT22_STATUS_t status, const DHT22_DATA_t* data)
+{
+	int16_t dt, dh;
+	uint32_t time = CLOCK_Millis();
+	uint16_t s;
+	
+	if (wait[sensor]) return;
+	if (queue_count > LOG_QUEUE_SIZE - LOG_BLOCK_WRITES) return; // Tried again with the next result.
+	wait[sensor] = ACQ_MS_TO_TICKS(LOG_PERIOD_MS);
+	
+	s = seconds(sensor, time);
+	if (status != DHT_DATA_READY){
+		if (open[sensor] != LOG_NONE && s <= LOG_MAX_SECONDS) append(sensor, LOG_ERROR_DELTA, status, s);
+		else{
+			new_block(sensor, LOG_ERROR_TEMPERATURE, status, time);
+			has_value[sensor] = 0;
+		}
+		return;
+	}
+	
+	dt = data->raw_temperature - last_temperature[sensor];
+	dh = data->raw_humidity - last_humidity[sensor];
+	if (open[sensor] != LOG_NONE && has_value[sensor] && s <= LOG_MAX_SECONDS &&
+			dt > LOG_ERROR_DELTA && dt <= INT8_MAX && dh >= INT8_MIN && dh <= INT8_MAX){
+		append(sensor, dt, dh, s);
+	}
+	else{
+		new_block(sensor, data->raw_temperature, data->raw_humidity, time);
+		has_value[sensor] = 1;
+	}
+	last_temperature[sensor] = data->raw_temperature;
+	last_humidity[sensor] = data->raw_humidity;
+}
+
+/*
+ * uint8_t LOG_Read(uint8_t index, LOG_BLOCK_t* block)
+ *
+ * Reads a block by index, 0 is the oldest one. Returns 0 if the block is
+ * empty (or index >= LOG_BLOCKS). The queued writes are not seen yet: a block
+ * is read as it was before them (they validate it last).
+ */
+uint8_t LOG_Read(uint8_t index, LOG_BLOCK_t* block)
+{
+	if (index >= LOG_BLOCKS) return 0;
+	eeprom_read_block(block, &log_blocks[(head + index) % LOG_BLOCKS], sizeof(LOG_BLOCK_t));
+	return block->sensor != LOG_EMPTY;
+}
+
+/*
+ * uint8_t LOG_Boot(void)
+ *
+ * Reset counter (wraps), stored in the blocks started since this reset.
+ */
+uint8_t LOG_Boot(void)
+{
+	return boot;
+}
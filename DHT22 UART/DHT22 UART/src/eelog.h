@@ -0,0 +1,83 @@
+/*
+ * eelog.h
+ *
+ * Store-and-forward log of the samples in the EEPROM, so the host can
+ * backfill the samples taken while it was disconnected (CMD_DUMP_LOG).
+ *
+ * Every LOG_PERIOD_MS the last result of each sensor is stored in a ring of
+ * LOG_BLOCKS blocks of 32 bytes. A block holds up to LOG_SAMPLES_PER_BLOCK
+ * samples of one sensor: the first one in full, with its time, and the next
+ * ones as 8 bit deltas (0.1 C, 0.1 %) to the previous one, with the seconds
+ * since it. An error is stored as the delta (LOG_ERROR_DELTA, error). A delta
+ * out of range, more than 255 s, or a sample in a block that starts with an
+ * error, starts a new block.
+ *
+ * Time: the time of a block is CLOCK_Millis() (clock.h), which restarts at
+ * each reset, so the block also holds the reset counter (LOG_Boot(), kept
+ * in the EEPROM). CMD_DUMP_LOG sends the current counter and time, so the
+ * host dates the blocks of the current boot, and those of a previous boot
+ * if it knew that boot's clock (Collector.cs).
+ *
+ * Wear leveling: the blocks are written in turn around the whole EEPROM and
+ * only the changed bytes are written. The count byte is the most written
+ * cell: LOG_SAMPLES_PER_BLOCK times per turn of the ring, so once per sample
+ * stored divided by LOG_BLOCKS. With LOG_PERIOD_MS of one minute that is
+ * 525600 * DHT22_SENSOR_COUNT / 31 writes a year: about 17000 per sensor,
+ * so the 100000 write cycles of the EEPROM last about 6 years with 1
+ * sensor, 3 years with 2 and 9 months with 8. Raise LOG_PERIOD_MS in
+ * proportion with many sensors.
+ *
+ * The bytes are queued and written one per tick by LOG_Tick(), so the
+ * main loop never waits for the EEPROM (3.4ms per byte). A reset loses the
+ * queued bytes, at most the last samples.
+ *
+ * After a reset the newest block is found from the sequence numbers, so the
+ * log survives power losses. A block is only valid once its sensor byte is
+ * written (last), a block interrupted by a reset is not dumped.
+ */
+
+#ifndef EELOG_H_
+#define EELOG_H_
+
+#include <stdint.h>
+
+#include "DHT22drv.h"
+
+#define LOG_PERIOD_MS 60000UL // Period of the stored samples of each sensor.
+#define LOG_SAMPLES_PER_BLOCK 7
+#define LOG_BLOCKS ((E2END + 1) / sizeof(LOG_BLOCK_t) - 1) // One block left for the device id (ident.h) and the reset counter.
+#define LOG_MAX_SECONDS 255 // Longest time between two samples of a block.
+
+#define LOG_ERROR_TEMPERATURE ((int16_t)0x8000) // First value of a block: error.
+#define LOG_ERROR_DELTA ((int8_t)0x80) // Temperature delta: error.
+#define LOG_EMPTY 0xFF // Sensor byte of an empty block.
+
+/* Sample after the first one of a block */
+typedef struct
+{
+	int8_t temperature; // Delta, or LOG_ERROR_DELTA.
+	int8_t humidity; // Delta, or the error.
+	uint8_t seconds; // Time since the previous sample.
+} LOG_DELTA_t;
+
+/* Block, as stored in the EEPROM and sent to the host (32 bytes) */
+typedef struct
+{
+	uint16_t seq; // Incremented with each new block.
+	uint8_t sensor;
+	uint8_t count; // Samples in the block (1 to LOG_SAMPLES_PER_BLOCK).
+	uint8_t boot; // Reset counter when the block was started.
+	uint32_t time; // CLOCK_Millis() of the first sample.
+	int16_t raw_temperature; // First sample, or LOG_ERROR_TEMPERATURE.
+	uint16_t raw_humidity; // First sample, or the error (DHT22_STATUS_t).
+	LOG_DELTA_t delta[LOG_SAMPLES_PER_BLOCK - 1];
+	uint8_t reserved;
+} LOG_BLOCK_t;
+
+void LOG_Init(void);
+void LOG_Tick(void);
+void LOG_Add(uint8_t sensor, DHT22_STATUS_t status, const DHT22_DATA_t* data);
+uint8_t LOG_Read(uint8_t index, LOG_BLOCK_t* block);
+uint8_t LOG_Boot(void);
+
+#endif /* EELOG_H_ */
@@ -0,0 +1,98 @@
+/*
+ * filter.c
+ *
+ * Median and EWMA filter of the samples. See filter.h.
+ */
+
+#include "filter.h"
+
+/* Quantities */
+enum
+{
+	FILTER_T = 0,
+	FILTER_H,
+	FILTER_QUANTITIES,
+};
+
+FILTER_CONFIG_t filter_config;
+
+static uint8_t seeded[DHT22_SENSOR_COUNT];
+static uint8_t pos[DHT22_SENSOR_COUNT]; // Next slot of history.
+static int16_t history[DHT22_SENSOR_COUNT][FILTER_QUANTITIES][FILTER_MAX_MEDIAN];
+static int32_t average[DHT22_SENSOR_COUNT][FILTER_QUANTITIES]; // 8 fractional bits
+
+void FILTER_Init(void)
+{
+	filter_config.median = FILTER_MEDIAN;
+	filter_config.alpha = FILTER_ALPHA;
+	FILTER_Reset();
+}
+
+/*
+ * void FILTER_Reset(void)
+ *
+ * Seeds the filters with the next sample of each sensor. Call after
+ * changing filter_config.
+ */
+void FILTER_Reset(void)
+{
+	uint8_t i;
+	
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		seeded[i] = 0;
+	}
+}
+
+/* Median of the n (odd) values of v. */
+static int16_t median(const int16_t* v, uint8_t n)
+{
+	int16_t sorted[FILTER_MAX_MEDIAN];
+	int16_t x;
+	uint8_t i, j;
+	
+	for (i = 0; i < n; i++){
+		x = v[i];
+		for (j = i; j > 0 && sorted[j - 1] > x; j--){
+			sorted[j] = sorted[j - 1];
+		}
+		sorted[j] = x;
+	}
+	return sorted[n / 2];
+}
+
+/* Filters one quantity. */
+static int16_t filter(uint8_t sensor, uint8_t q, int16_t x)
+{
+	int32_t* y = &average[sensor][q];
+	uint8_t i;
+	
+	if (!seeded[sensor]){
+		for (i = 0; i < FILTER_MAX_MEDIAN; i++){
+			history[sensor][q][i] = x;
+		}
+		*y = (int32_t)x << 8;
+		return x;
+	}
+	
+	history[sensor][q][pos[sensor]] = x;
+	x = median(history[sensor][q], filter_config.median);
+	// Rounded step: a truncated one stops short of x by up to 1/alpha units, below it only.
+	*y += (((((int32_t)x << 8) - *y) * filter_config.alpha) + 128) >> 8;
+	return (*y + 128) >> 8; // Rounded
+}
+
+/*
+ * void FILTER_Apply(uint8_t sensor, DHT22_DATA_t* data)
+ *
+ * Replaces a sample by its filtered value.
+ */
+void FILTER_Apply(uint8_t sensor, DHT22_DATA_t* data)
+{
+	data->raw_temperature = filter(sensor, FILTER_T, data->raw_temperature);
+	data->raw_humidity = filter(sensor, FILTER_H, data->raw_humidity);
+	if (!seeded[sensor]){
+		seeded[sensor] = 1;
+		pos[sensor] = 0;
+	}
+	if (++pos[sensor] >= filter_config.median) pos[sensor] = 0;
+}
@@ -0,0 +1,47 @@
+/*
+ * filter.h
+ *
+ * Filter of the samples of each sensor, applied before they are sent,
+ * cached or logged (report.c). Integer arithmetic only.
+ *
+ * 1. Median of the last filter_config.median samples (1, 3 or 5; 1 disables
+ *    it): a single sample spike that passed the checksum is rejected, at the
+ *    cost of a delay of (median - 1) / 2 samples.
+ * 2. Exponential moving average: y += alpha * (x - y), alpha being
+ *    filter_config.alpha / 256 (256 disables it). The average is kept with
+ *    8 fractional bits (0.1 / 256 units), so small alphas do not get stuck.
+ *    The arithmetic is checked against a floating point reference by the
+ *    monitor ("/filter", FilterCheck.cs): within 1 unit (0.1) of it.
+ *
+ * The first sample of a sensor, and the first one after a change of the
+ * configuration, seed the filter.
+ */
+
+#ifndef FILTER_H_
+#define FILTER_H_
+
+#include <stdint.h>
+
+#include "DHT22drv.h"
+
+#define FILTER_MAX_MEDIAN 5
+#define FILTER_ALPHA_ONE 256
+
+/* Defaults: no filtering */
+#define FILTER_MEDIAN 1
+#define FILTER_ALPHA FILTER_ALPHA_ONE
+
+/* Configuration */
+typedef struct
+{
+	uint8_t median; // Samples of the median (1, 3 or 5).
+	uint16_t alpha; // EWMA factor, 1 to FILTER_ALPHA_ONE (/256).
+} FILTER_CONFIG_t;
+
+extern FILTER_CONFIG_t filter_config;
+
+void FILTER_Init(void);
+void FILTER_Reset(void);
+void FILTER_Apply(uint8_t sensor, DHT22_DATA_t* data);
+
+#endif /* FILTER_H_ */
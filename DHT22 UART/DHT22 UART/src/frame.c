@@ -0,0 +1,110 @@
+/*
+ * frame.c
+ *
+ * Binary frames of the serial protocol. See frame.h.
+ */
+
+#include <avr/io.h>
+#include <util/crc16.h>
+
+#include "frame.h"
+#include "uart.h"
+
+#if (FRAME_WINDOW_SIZE != 256)
+#error "FRAME_WINDOW_SIZE must be 256 (uint8_t index)"
+#endif
+
+/* Retransmit window: ring of the last numbered frames, stored as
+   <type> <len> <payload>. slot[] locates them by seq. */
+typedef struct
+{
+	uint8_t seq;
+	uint8_t valid;
+	uint16_t start; // Position in the window (count of bytes written).
+} FRAME_SLOT_t;
+
+static uint8_t window[FRAME_WINDOW_SIZE];
+static uint16_t window_head; // Bytes written to the window (wraps).
+static FRAME_SLOT_t slot[FRAME_WINDOW_FRAMES];
+static uint8_t tx_seq;
+
+static void store(uint8_t data)
+{
+	window[(uint8_t)window_head++] = data;
+}
+
+/* Sends a byte of the frame and updates its CRC. */
+static uint16_t put(uint16_t crc, uint8_t data)
+{
+	uart_putc(data);
+	return _crc16_update(crc, data);
+}
+
+static void put_crc(uint16_t crc)
+{
+	uart_putc((uint8_t)crc);
+	uart_putc((uint8_t)(crc >> 8));
+}
+
+/*
+ * void FRAME_Send(uint8_t type, const void* payload, uint8_t len)
+ *
+ * Queues a frame for transmission (uart.c TX ring buffer). Blocks only if
+ * the ring buffer is full. A numbered frame (FRAME_NUMBERED) gets the next
+ * sequence number and is kept in the retransmit window.
+ */
+void FRAME_Send(uint8_t type, const void* payload, uint8_t len)
+{
+	const uint8_t* p = payload;
+	uint8_t numbered = FRAME_NUMBERED(type);
+	uint8_t seq = 0;
+	uint16_t crc = 0xFFFF;
+	FRAME_SLOT_t* s;
+	
+	if (numbered){
+		seq = tx_seq++;
+		s = &slot[seq & (FRAME_WINDOW_FRAMES - 1)];
+		s->seq = seq;
+		s->valid = 1;
+		s->start = window_head;
+		store(type);
+		store(len);
+	}
+	uart_putc(FRAME_SYNC);
+	crc = put(crc, type);
+	crc = put(crc, len);
+	crc = put(crc, seq);
+	while (len--){
+		if (numbered) store(*p);
+		crc = put(crc, *p++);
+	}
+	put_crc(crc);
+}
+
+/*
+ * uint8_t FRAME_Resend(uint8_t seq)
+ *
+ * Sends again the numbered frame seq, if it is still in the retransmit
+ * window. Returns 1 if it was sent, 0 otherwise.
+ */
+uint8_t FRAME_Resend(uint8_t seq)
+{
+	FRAME_SLOT_t* s = &slot[seq & (FRAME_WINDOW_FRAMES - 1)];
+	uint16_t crc = 0xFFFF;
+	uint8_t pos, len;
+	
+	// The slot must hold this seq and its bytes must not be overwritten yet.
+	if (!s->valid || s->seq != seq) return 0;
+	if ((uint16_t)(window_head - s->start) > FRAME_WINDOW_SIZE) return 0;
+	pos = (uint8_t)s->start;
+	uart_putc(FRAME_SYNC);
+	crc = put(crc, window[pos++]); // type
+	len = window[pos++];
+	crc = put(crc, len);
+	crc = put(crc, seq);
+	while (len--){
+		crc = put(crc, window[pos++]);
+	}
+	put_crc(crc);
+	return 1;
+}
@@ -0,0 +1,60 @@
+/*
+ * frame.h
+ *
+ * Binary frames of the serial protocol.
+ *
+ * Device to host:  FRAME_SYNC <type> <len> <seq> <payload (len bytes)> <crc>
+ * Host to device:  CMD_SYNC   <cmd>  <len> <payload (len bytes)> <crc>
+ *
+ * crc is the CRC-16 (polynomial 0xA001, initial value 0xFFFF, the Modbus one)
+ * of all the bytes after the sync, sent low byte first: the CRC of the whole
+ * frame after the sync is then 0. Multi-byte values are little endian. In
+ * ASCII format the samples are sent as text lines ("OK,...\n"), they never
+ * start with FRAME_SYNC, so the host can tell lines and frames apart by the
+ * first byte. The lines are not protected.
+ *
+ * Link layer: the frames for which FRAME_NUMBERED(type) is true get the next
+ * sequence number (uint8, wraps) and are kept in a window of the last frames
+ * sent (FRAME_WINDOW_SIZE bytes, at most FRAME_WINDOW_FRAMES frames). The
+ * host that sees a gap in the sequence numbers or a frame with a bad CRC asks
+ * for the missing range with CMD_NACK, and the device sends those frames
+ * again, unchanged, as long as they are in the window. The other frames
+ * (replies and the dumps sent on request) carry seq 0, the host repeats the
+ * command instead. So a clean line costs 2 bytes per frame and no
+ * retransmission.
+ */
+
+#ifndef FRAME_H_
+#define FRAME_H_
+
+#include <stdint.h>
+
+#define FRAME_SYNC 0xA5 // Start of a device to host frame.
+#define CMD_SYNC 0x5A // Start of a host to device frame (command).
+
+#define FRAME_MAX_PAYLOAD 80
+#define FRAME_WINDOW_SIZE 256 // Bytes of the retransmit window (256: the index wraps by itself).
+#define FRAME_WINDOW_FRAMES 16 // Frames in the retransmit window (power of 2).
+
+/* Frame types, device to host */
+#define FRAME_SAMPLE 0x10 // sensor, int16 temperature (0.1 C), uint16 humidity (0.1 %), uint32 time (ms, clock.h)
+#define FRAME_ERROR 0x11 // sensor, error (DHT22_STATUS_t)
+#define FRAME_HEALTH 0x12 // sensor, ACQ_STATS_t, uint32 awake, uint32 asleep (ms since start-up, clock.h), MEM_STATS_t
+#define FRAME_HIST 0x13 // sensor, kind, DHT22_HIST_BINS x uint16
+#define FRAME_LOG 0x14 // count, count x LOG_BLOCK_t (eelog.h)
+#define FRAME_AGGREGATE 0x15 // sensor, uint16 count, uint16 errors, int16 temperature min, max (0.1 C), mean (0.01 C),
+                             // uint16 humidity min, max (0.1 %), mean (0.01 %)
+#define FRAME_BATCH 0x16 // uint32 time of the first entry (ms, clock.h), count, count x entry:
+                         // sensor (bit 7: error), time offset (ACQ_TICK_MS), int16 temperature or error, uint16 humidity
+#define FRAME_KEY 0x17 // sensor, seq, int16 temperature, uint16 humidity
+#define FRAME_DELTA4 0x18 // sensor (4 bit) | seq (4 bit), temperature delta (4 bit) | humidity delta (4 bit)
+#define FRAME_DELTA8 0x19 // sensor (4 bit) | seq (4 bit), int8 temperature delta, int8 humidity delta
+#define FRAME_TRACE 0x1A // count, count x PROF_TRACE_t (prof.h)
+#define FRAME_REPLY 0x80 // Reply to a command: FRAME_REPLY | cmd
+
+#define FRAME_NUMBERED(type) ((type) < FRAME_REPLY && (type) != FRAME_LOG && (type) != FRAME_HIST && (type) != FRAME_TRACE)
+
+void FRAME_Send(uint8_t type, const void* payload, uint8_t len);
+uint8_t FRAME_Resend(uint8_t seq);
+
+#endif /* FRAME_H_ */
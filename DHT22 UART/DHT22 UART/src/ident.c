@@ -0,0 +1,21 @@
+/*
+ * ident.c
+ *
+ * Identity of the device. See ident.h.
+ */
+
+#include <avr/eeprom.h>
+
+#include "ident.h"
+
+static uint32_t EEMEM ident_id = IDENT_NONE;
+
+uint32_t IDENT_Get(void)
+{
+	return eeprom_read_dword(&ident_id);
+}
+
+void IDENT_Set(uint32_t id)
+{
+	eeprom_update_dword(&ident_id, id);
+}
@@ -0,0 +1,26 @@
+/*
+ * ident.h
+ *
+ * Identity of the device, so the host can tell the devices apart whatever
+ * port they are plugged in and find them all at start-up (CMD_IDENTIFY,
+ * command.h).
+ *
+ * The device id is kept in the EEPROM, out of the log (eelog.h). An erased
+ * EEPROM reads IDENT_NONE: the host gives the device an id with CMD_SET_ID
+ * the first time it sees it. IDENT_VERSION changes with each firmware
+ * release that changes the protocol.
+ */
+
+#ifndef IDENT_H_
+#define IDENT_H_
+
+#include <stdint.h>
+
+#define IDENT_VERSION_MAJOR 2
+#define IDENT_VERSION_MINOR 0
+#define IDENT_NONE 0xFFFFFFFFUL // No id assigned.
+
+uint32_t IDENT_Get(void);
+void IDENT_Set(uint32_t id);
+
+#endif /* IDENT_H_ */
@@ -1,79 +1,55 @@
 #include<avr/io.h>
-#include<stdio.h>
 #include<avr/interrupt.h>
-#include "DHT22.h"
-
-#define F_CPU 16000000UL
-#define USART_BAUDRATE 9600
-#define BAUD_PRESCALE (((F_CPU/(USART_BAUDRATE*16UL)))-1)
-
-void uart0_init(void);
-void send_char(char c);
-void send_string(char s[]);
-char get_char(void);
+#include "DHT22drv.h"
+#include "acquisition.h"
+#include "baud.h"
+#include "clock.h"
+#include "command.h"
+#include "eelog.h"
+#include "filter.h"
+#include "mem.h"
+#include "modbus.h"
+#include "prof.h"
+#include "report.h"
+#include "uart.h"
 
 int main(void){
-	uart0_init();
-
-	DHT22_ERROR_t error;
-	DHT22_DATA_t data;
-	cli();
+	MEM_Init();
+	CLOCK_Init();
+#if (PROF_ENABLE == 1)
+	PROF_Init();
+#endif
+	uart_init(BAUD_SETTING(USART_BAUDRATE));
+	REPORT_Init();
+	FILTER_Init();
+	LOG_Init();
+#if (MODBUS_ENABLE == 1)
+	MB_Init();
+#else
+	CMD_Init();
+#endif
+	ACQ_Init();
+	sei(); // enable interrupt (UART, clock and interrupt driven backends)
 
 	while(1)
 	{
-		error = readDHT22(&data);
-		_delay_ms(400);
-		if (error == DHT_ERROR_NONE){
-			char str[20];
-			sprintf(str,"OK,%i.%u,%u.%u\n",data.temperature_integral,data.temperature_decimal, data.humidity_integral, data.humidity_decimal);
-			send_string(str);			
-		}
-		else{
-			char err[10];
-			sprintf(err,"ERROR,%i\n",error);
-			send_string(err);
-		}
+		PROF_BEGIN(PROF_CMD);
+#if (MODBUS_ENABLE == 1)
+		MB_Poll();
+#else
+		CMD_Poll();
+		BAUD_Tick();
+#endif
+		PROF_END(PROF_CMD);
+		PROF_BEGIN(PROF_ACQ);
+		ACQ_Tick();
+		PROF_END(PROF_ACQ);
+		PROF_BEGIN(PROF_REPORT);
+		LOG_Tick();
+		REPORT_Tick();
+		PROF_END(PROF_REPORT);
+		CLOCK_WaitTick(ACQ_TICK_MS);
 	}
 	
-	sei(); // enable interrupt
 	return 0;
 }
-
-char get_char(void)
-{
-	// wait until the port is ready to be read
-	//loop_until_bit_is_set(UCSR0A,RXC0);
-	while( ( UCSR0A & ( 1 << RXC0 ) ) == 0 ){}
-	
-	// return the byte from the serial port
-	return UDR0;
-}
-
-void send_char(char c)
-{
-	// wait until the port is ready to be written to
-	while ((UCSR0A & (1 << UDRE0)) == 0) {};
-	
-	// write the byte to the serial port
-	UDR0 = c;
-}
-
-void send_string(char s[])
-{
-   int i = 0;
-   
-   // send every char in the string
-   while (s[i] != 0x00)
-   {
-	   send_char(s[i]);
-	   i++;
-   }
-}
-
-void uart0_init(void)
-{
-	UCSR0B |= (1<<RXEN0)  | (1<<TXEN0);  // Enable RX and TX
-	UCSR0C |= (1<<UCSZ00) | (1<<UCSZ01); // 8-bit data
-	UBRR0H  = (BAUD_PRESCALE >> 8);
-	UBRR0L  = BAUD_PRESCALE;
-}
\ No newline at end of file
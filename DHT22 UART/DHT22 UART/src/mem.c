@@ -0,0 +1,47 @@
+/*
+ * mem.c
+ *
+ * RAM usage instrumentation. See mem.h.
+ */
+
+#include <avr/io.h>
+
+#include "mem.h"
+
+/* Linker symbols (avr-libc default linker script) */
+extern uint8_t __data_start;
+extern uint8_t _end;
+
+/*
+ * void MEM_Init(void)
+ *
+ * Paints the free RAM with MEM_CANARY. Must be called first in main(), with
+ * the interrupts disabled.
+ */
+void MEM_Init(void)
+{
+	uint8_t* p = &_end;
+	uint8_t* top = (uint8_t*)SP - MEM_MARGIN;
+	
+	while (p < top){
+		*p++ = MEM_CANARY;
+	}
+}
+
+/*
+ * void MEM_Get(MEM_STATS_t* stats)
+ *
+ * Returns the RAM usage. Scans the free RAM (about 1 KB at most), so it is
+ * meant for the periodic health records, not for every tick.
+ */
+void MEM_Get(MEM_STATS_t* stats)
+{
+	const uint8_t* p = &_end;
+	
+	while (p <= (const uint8_t*)RAMEND && *p == MEM_CANARY){
+		p++;
+	}
+	stats->static_bytes = (uint16_t)(&_end - &__data_start);
+	stats->free_min = (uint16_t)(p - &_end);
+	stats->stack_peak = (uint16_t)((const uint8_t*)RAMEND + 1 - p);
+}
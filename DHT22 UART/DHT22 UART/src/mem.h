@@ -0,0 +1,38 @@
+/*
+ * mem.h
+ *
+ * RAM usage instrumentation, sent in the health records (report.h).
+ *
+ * MEM_Init() (first thing in main()) paints the free RAM, between the end of
+ * the static data (.data, .bss and .noinit, linker symbol _end) and the
+ * stack, with MEM_CANARY. The stack grows down over it and MEM_Get() scans
+ * from _end up to the first overwritten byte: the free RAM that was never
+ * touched, so the stack high-water mark since start-up (interrupts
+ * included). There is no heap, malloc is not used.
+ *
+ * The static RAM of each subsystem is in the linker map (Debug/Testing.map),
+ * the host reports it per object file (MapReport.cs). Together they tell how
+ * much a buffer can grow: free_min is the margin left at the worst stack
+ * depth seen so far.
+ */
+
+#ifndef MEM_H_
+#define MEM_H_
+
+#include <stdint.h>
+
+#define MEM_CANARY 0xC5
+#define MEM_MARGIN 16 // Bytes below the stack pointer of main() not painted.
+
+/* RAM usage (bytes) */
+typedef struct
+{
+	uint16_t static_bytes; // .data, .bss and .noinit.
+	uint16_t stack_peak; // Deepest stack seen.
+	uint16_t free_min; // RAM never used between the static data and the stack.
+} MEM_STATS_t;
+
+void MEM_Init(void);
+void MEM_Get(MEM_STATS_t* stats);
+
+#endif /* MEM_H_ */
@@ -0,0 +1,261 @@
+/*
+ * modbus.c
+ *
+ * Modbus RTU slave. See modbus.h.
+ */
+
+#include <stddef.h>
+#include <string.h>
+#include <avr/io.h>
+#include <avr/interrupt.h>
+#include <util/crc16.h>
+
+#include "acquisition.h"
+#include "cache.h"
+#include "modbus.h"
+#include "report.h"
+#include "uart.h"
+
+#if (MODBUS_ENABLE == 1)
+
+#if (DHT22_BACKEND == DHT22_BACKEND_BUSYWAIT)
+#error "modbus.c: the blocking backend disables the interrupts for ~6ms while a reply is sent, use an interrupt backend (config/conf_dht.h)."
+#endif
+
+#define MB_IR_COUNT (DHT22_SENSOR_COUNT * MB_IR_BLOCK)
+
+static uint8_t rx_buf[MB_MAX_REQUEST]; // Last bytes received
+static uint8_t rx_len;
+static uint8_t rx_clean; // rx_buf[rx_clean..] was received without error.
+static uint16_t tx_crc;
+
+/* Reply. The bytes are queued in the uart.c TX buffer. */
+static void tx_begin(void)
+{
+	UCSR0A = (UCSR0A & ((1 << U2X0) | (1 << MPCM0))) | (1 << TXC0); // Clear the flag of previous transmissions (the error flags must be written 0).
+	MODBUS_DE_PORT |= (1 << MODBUS_DE_PIN);
+	tx_crc = 0xFFFF;
+}
+
+static void tx_byte(uint8_t data)
+{
+	tx_crc = _crc16_update(tx_crc, data);
+	uart_putc(data);
+}
+
+static void tx_end(void)
+{
+	uart_putc((uint8_t)tx_crc);
+	uart_putc((uint8_t)(tx_crc >> 8));
+	UCSR0B |= (1 << TXCIE0); // Release the bus when the last byte is out.
+}
+
+/* Releases the bus once the TX buffer is empty (uart.c disables UDRIE0). */
+ISR(USART_TX_vect)
+{
+	if (UCSR0B & (1 << UDRIE0)) return; // More bytes queued.
+	MODBUS_DE_PORT &= ~(1 << MODBUS_DE_PIN);
+	UCSR0B &= ~(1 << TXCIE0);
+}
+
+static void exception(uint8_t function, uint8_t code)
+{
+	tx_begin();
+	tx_byte(MODBUS_ADDRESS);
+	tx_byte(function | 0x80);
+	tx_byte(code);
+	tx_end();
+}
+
+static uint16_t input_register(uint16_t reg)
+{
+	uint8_t sensor = reg / MB_IR_BLOCK;
+	uint8_t offset = reg % MB_IR_BLOCK;
+	const ACQ_STATS_t* stats = &acq_stats[sensor];
+	const CACHE_RECORD_t* r = NULL;
+	uint8_t age;
+	
+	if (offset <= MB_IR_SEQ){
+		for (age = 0; age < CACHE_Count(); age++){
+			if (CACHE_Get(age)->sensor == sensor){
+				r = CACHE_Get(age);
+				break;
+			}
+		}
+	}
+	switch (offset){
+		case MB_IR_TEMPERATURE: return (r) ? (uint16_t)r->raw_temperature : 0;
+		case MB_IR_HUMIDITY: return (r) ? r->raw_humidity : 0;
+		case MB_IR_STATUS: return (r) ? r->status : 0xFFFF;
+		case MB_IR_SEQ: return (r) ? r->seq : 0;
+		case MB_IR_OK: return stats->ok;
+		case MB_IR_RETRIES: return stats->retries;
+		case MB_IR_LOST: return stats->lost;
+		case MB_IR_POWER_CYCLES: return stats->power_cycles;
+		default:
+			if (offset < MB_IR_ERR + DHT_ERROR_CHECKSUM){
+				return stats->err[DHT_BUS_HUNG + offset - MB_IR_ERR];
+			}
+			return 0; // Reserved
+	}
+}
+
+static uint16_t holding_register(uint16_t reg)
+{
+	switch (reg){
+		case MB_HR_PERIOD: return acq_config.period_ms;
+		case MB_HR_ENABLED: return acq_config.enabled;
+		default: return 0;
+	}
+}
+
+/* Checks (write = 0) or writes (write = 1) a holding register.
+   Returns 0 or the exception code. */
+static uint8_t write_register(uint16_t reg, uint16_t value, uint8_t write)
+{
+	switch (reg){
+		case MB_HR_PERIOD:
+			if (value < ACQ_MIN_PERIOD_MS) return MB_EX_VALUE;
+			if (write) acq_config.period_ms = value;
+			return 0;
+		case MB_HR_ENABLED:
+			if (value >> DHT22_SENSOR_COUNT) return MB_EX_VALUE;
+			if (write) acq_config.enabled = value;
+			return 0;
+		case MB_HR_RESET:
+			if (value > 1) return MB_EX_VALUE;
+			if (write && value) ACQ_ClearStats();
+			return 0;
+		default:
+			return MB_EX_ADDRESS;
+	}
+}
+
+/* Executes a request with a valid CRC. Returns the exception code or 0. */
+static uint8_t execute(const uint8_t* p, uint8_t len, uint8_t reply)
+{
+	uint16_t start = ((uint16_t)p[2] << 8) | p[3];
+	uint16_t count = ((uint16_t)p[4] << 8) | p[5];
+	uint16_t limit, i;
+	uint8_t ex;
+	
+	switch (p[1]){
+		case MB_READ_HOLDING:
+		case MB_READ_INPUT:
+			if (!reply) return 0; // Broadcast
+			if (len != 8) return MB_EX_VALUE;
+			if (count == 0 || count > MB_MAX_READ) return MB_EX_VALUE;
+			limit = (p[1] == MB_READ_INPUT) ? MB_IR_COUNT : MB_HR_COUNT;
+			if (start >= limit || count > limit - start) return MB_EX_ADDRESS;
+			tx_begin();
+			tx_byte(MODBUS_ADDRESS);
+			tx_byte(p[1]);
+			tx_byte(count * 2);
+			for (i = start; i < start + count; i++){
+				uint16_t value = (p[1] == MB_READ_INPUT) ? input_register(i) : holding_register(i);
+				tx_byte(value >> 8);
+				tx_byte(value);
+			}
+			tx_end();
+			return 0;
+			
+		case MB_WRITE_SINGLE:
+			if (len != 8) return MB_EX_VALUE;
+			ex = write_register(start, count, 0); // count is the value
+			if (ex) return ex;
+			write_register(start, count, 1);
+			break;
+			
+		case MB_WRITE_MULTIPLE:
+			if (len < 9 || len != 9 + p[6] || p[6] != count * 2) return MB_EX_VALUE;
+			if (count == 0 || start >= MB_HR_COUNT || count > MB_HR_COUNT - start) return MB_EX_ADDRESS;
+			for (i = 0; i < count; i++){
+				ex = write_register(start + i, ((uint16_t)p[7 + 2 * i] << 8) | p[8 + 2 * i], 0);
+				if (ex) return ex;
+			}
+			for (i = 0; i < count; i++){
+				write_register(start + i, ((uint16_t)p[7 + 2 * i] << 8) | p[8 + 2 * i], 1);
+			}
+			break;
+			
+		default:
+			return MB_EX_FUNCTION;
+	}
+	
+	// Write reply: echo of address, function, start and value/count
+	if (reply){
+		tx_begin();
+		for (i = 0; i < 6; i++){
+			tx_byte(p[i]);
+		}
+		tx_end();
+	}
+	return 0;
+}
+
+/* Executes p if it is a frame to this node. Returns 0 if it is not (CRC or address). */
+static uint8_t request(const uint8_t* p, uint8_t len)
+{
+	uint16_t crc = 0xFFFF;
+	uint8_t i, ex;
+	
+	if (len < 4) return 0;
+	if (p[0] != MODBUS_ADDRESS && p[0] != MB_BROADCAST) return 0;
+	for (i = 0; i < len; i++){
+		crc = _crc16_update(crc, p[i]);
+	}
+	if (crc != 0) return 0; // The CRC of a frame with its CRC appended is 0.
+	
+	ex = (len < 8) ? MB_EX_VALUE : execute(p, len, p[0] != MB_BROADCAST);
+	if (ex && p[0] != MB_BROADCAST) exception(p[1], ex);
+	return 1;
+}
+
+/*
+ * void MB_Init(void)
+ *
+ * Call after uart_init() and REPORT_Init(): sets the serial format and the
+ * poll mode (the bus is only used to answer the master).
+ */
+void MB_Init(void)
+{
+	MODBUS_DE_PORT &= ~(1 << MODBUS_DE_PIN);
+	MODBUS_DE_DDR |= (1 << MODBUS_DE_PIN);
+	UCSR0C = (1 << UPM01) | (1 << UCSZ01) | (1 << UCSZ00); // 8E1
+	report_mode = REPORT_POLL;
+}
+
+/*
+ * void MB_Poll(void)
+ *
+ * Reads the received bytes (does not block). When the line has been idle for
+ * a tick, executes the longest frame to this node that ends the burst.
+ */
+void MB_Poll(void)
+{
+	unsigned int c;
+	uint8_t received = 0;
+	uint8_t start;
+	
+	while (!((c = uart_getc()) & UART_NO_DATA)){
+		received = 1;
+		if (rx_len == MB_MAX_REQUEST){
+			// Keep the last bytes: the request is at the end of the burst.
+			memmove(rx_buf, rx_buf + 1, MB_MAX_REQUEST - 1);
+			rx_len--;
+			if (rx_clean) rx_clean--;
+		}
+		rx_buf[rx_len++] = (uint8_t)c;
+		if (c & (UART_FRAME_ERROR | UART_OVERRUN_ERROR | UART_PARITY_ERROR | UART_BUFFER_OVERFLOW)) rx_clean = rx_len;
+	}
+	
+	if (!received && rx_len){
+		for (start = rx_clean; start < rx_len; start++){
+			if (request(rx_buf + start, rx_len - start)) break;
+		}
+		rx_len = 0;
+		rx_clean = 0;
+	}
+}
+
+#endif /* MODBUS_ENABLE */
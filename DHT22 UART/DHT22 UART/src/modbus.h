@@ -0,0 +1,91 @@
+/*
+ * modbus.h
+ *
+ * Modbus RTU slave over an RS-485 transceiver (config/conf_modbus.h).
+ *
+ * MB_Poll() must be called every ACQ_TICK_MS instead of CMD_Poll(). A burst
+ * ends when a whole tick passes without bytes (the RTU 3.5 character silence
+ * is shorter). A master that does not wait that long sends the next request
+ * right after the reply of another node, and both are received as one burst:
+ * so the last MB_MAX_REQUEST bytes are kept and the longest frame with a valid
+ * CRC and this address that ends the burst is executed. The master should
+ * still leave 2 ticks of silence before a request (Modbus.cs in the monitor).
+ * The reply is sent with the driver enabled; the transmit complete interrupt
+ * releases the bus after the last byte. Serial format: 8 data bits, even
+ * parity, 1 stop bit, USART_BAUDRATE (config/conf_uart.h).
+ *
+ * Functions: 0x03 read holding registers, 0x04 read input registers,
+ * 0x06 write single register, 0x10 write multiple registers. Requests to
+ * address 0 (broadcast) are executed without reply.
+ *
+ * Input registers, one block of MB_IR_BLOCK registers per sensor
+ * (register = sensor * MB_IR_BLOCK + offset), from the last record of the
+ * sensor in the cache (cache.h) and its statistics (acquisition.h):
+ *   MB_IR_TEMPERATURE   int16, 0.1 C
+ *   MB_IR_HUMIDITY      0.1 %
+ *   MB_IR_STATUS        DHT22_STATUS_t of the last reading, 0xFFFF if none yet
+ *   MB_IR_SEQ           Sequence number of the last record
+ *   MB_IR_OK            Successful readings
+ *   MB_IR_ERR           6 registers, errors DHT_BUS_HUNG to DHT_ERROR_CHECKSUM
+ *   MB_IR_RETRIES, MB_IR_LOST, MB_IR_POWER_CYCLES
+ * A read is limited to MB_MAX_READ registers, 7 blocks: a master reads the
+ * sensors of a node 7 at a time (start sensor * MB_IR_BLOCK, (n - 1) *
+ * MB_IR_BLOCK + MB_IR_POWER_CYCLES + 1 registers for n sensors), so a node of
+ * 8 sensors takes 2 requests.
+ *
+ * Holding registers:
+ *   MB_HR_PERIOD        Sample period (ms, ACQ_MIN_PERIOD_MS minimum)
+ *   MB_HR_ENABLED       Bit n enables sensor n
+ *   MB_HR_RESET         Write 1 to clear the statistics (reads 0)
+ *
+ * The blocking backend is not supported (#error): it disables the interrupts
+ * for ~6ms while reading a sensor, and a reply being sent would stop for that
+ * long, a gap longer than the 1.5 characters an RTU master accepts in a frame.
+ * A reply is queued with uart_putc() and MB_Poll() waits while the TX buffer is
+ * full (about 220ms for 125 registers at 9600 baud).
+ */
+
+#ifndef MODBUS_H_
+#define MODBUS_H_
+
+#include <stdint.h>
+
+#include "conf_modbus.h"
+
+/* Input registers (offset in the block of a sensor) */
+#define MB_IR_TEMPERATURE 0
+#define MB_IR_HUMIDITY 1
+#define MB_IR_STATUS 2
+#define MB_IR_SEQ 3
+#define MB_IR_OK 4
+#define MB_IR_ERR 5
+#define MB_IR_RETRIES 11
+#define MB_IR_LOST 12
+#define MB_IR_POWER_CYCLES 13
+#define MB_IR_BLOCK 16
+
+/* Holding registers */
+#define MB_HR_PERIOD 0
+#define MB_HR_ENABLED 1
+#define MB_HR_RESET 2
+#define MB_HR_COUNT 3
+
+/* Function codes */
+#define MB_READ_HOLDING 0x03
+#define MB_READ_INPUT 0x04
+#define MB_WRITE_SINGLE 0x06
+#define MB_WRITE_MULTIPLE 0x10
+
+/* Exception codes */
+#define MB_EX_FUNCTION 0x01
+#define MB_EX_ADDRESS 0x02
+#define MB_EX_VALUE 0x03
+
+#define MB_BROADCAST 0
+#define MB_MAX_REQUEST 16 // Longest request accepted (write of MB_HR_COUNT registers).
+#define MB_MAX_READ 125 // Registers per read (Modbus limit).
+
+void MB_Init(void);
+void MB_Poll(void);
+
+#endif /* MODBUS_H_ */
@@ -0,0 +1,59 @@
+/*
+ * prof.c
+ *
+ * Profiling markers. See prof.h.
+ */
+
+#include <avr/interrupt.h>
+#include <string.h>
+
+#include "prof.h"
+
+#if (PROF_ENABLE == 1)
+
+PROF_STATS_t prof_stats[PROF_IDS];
+PROF_TRACE_t prof_trace[PROF_TRACE_SIZE];
+uint8_t prof_trace_head;
+
+/*
+ * void PROF_Init(void)
+ *
+ * Sets the marker pins as outputs (low) and starts Timer1, unless the ICP
+ * backend uses it (DHT22_Init() starts it then).
+ */
+void PROF_Init(void)
+{
+	PROF_Clear();
+	PROF_PORT &= ~(PROF_TIMER_MASK | PROF_EDGE_MASK | PROF_UART_RX_MASK | PROF_UART_TX_MASK |
+	               PROF_ACQ_MASK | PROF_CMD_MASK | PROF_REPORT_MASK);
+	PROF_DDR |= PROF_TIMER_MASK | PROF_EDGE_MASK | PROF_UART_RX_MASK | PROF_UART_TX_MASK |
+	            PROF_ACQ_MASK | PROF_CMD_MASK | PROF_REPORT_MASK;
+#if (DHT22_BACKEND != DHT22_BACKEND_ICP)
+	TCCR1A = 0; // Normal mode, free running.
+#if (PROF_PRESCALER == 1)
+	TCCR1B = (1 << CS10);
+#elif (PROF_PRESCALER == 8)
+	TCCR1B = (1 << CS11);
+#else
+#error "prof: PROF_PRESCALER must be 1 or 8."
+#endif
+#endif
+}
+
+/*
+ * void PROF_Clear(void)
+ *
+ * Clears the statistics and the trace.
+ */
+void PROF_Clear(void)
+{
+	uint8_t sreg = SREG;
+	
+	cli();
+	memset(prof_stats, 0, sizeof(prof_stats));
+	memset(prof_trace, PROF_TRACE_EMPTY, sizeof(prof_trace));
+	prof_trace_head = 0;
+	SREG = sreg;
+}
+
+#endif
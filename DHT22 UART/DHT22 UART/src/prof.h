@@ -0,0 +1,118 @@
+/*
+ * prof.h
+ *
+ * Profiling markers of the interrupt handlers and the main loop tasks.
+ *
+ * Optional instrumentation: when PROF_ENABLE is 1 (config/conf_prof.h),
+ * PROF_BEGIN(id) and PROF_END(id) around a section raise its marker pin
+ * (PROF_xxx_MASK) and stamp Timer1, so the section can be seen on a scope
+ * and its duration is accumulated per id (count, min, max and sum, the host
+ * shows the average) and written in a trace of the last PROF_TRACE_SIZE
+ * sections run. With PROF_ENABLE 0 the macros are empty.
+ *
+ * Durations are in Timer1 counts of PROF_CYCLES_PER_COUNT cycles. They
+ * include the interrupts that preempted a main loop task, and for a handler
+ * they do not include the vector jump, prologue and epilogue (about 48
+ * cycles for the DHT22 edge handler, see DHT22int.h). The markers add about 30 cycles to a
+ * handler, and more registers to save. A section longer than 65535 counts
+ * wraps: use PROF_PRESCALER 8 with the blocking backend.
+ *
+ * The statistics and the trace are sent with CMD_DUMP_PROF (command.h).
+ */
+
+#ifndef PROF_H_
+#define PROF_H_
+
+#include <avr/interrupt.h>
+#include <avr/io.h>
+#include <stdint.h>
+
+#include "DHT22drv.h"
+#include "conf_prof.h"
+
+/* Profiled sections */
+enum
+{
+	PROF_TIMER = 0,	// DHT22 timer compare handler (DHT22int.c).
+	PROF_EDGE,		// DHT22 edge handler: INT0, PCINT or ICP (DHT22int.c).
+	PROF_UART_RX,	// UART receive handler (uart.c).
+	PROF_UART_TX,	// UART data register empty handler (uart.c).
+	PROF_ACQ,		// ACQ_Tick().
+	PROF_CMD,		// CMD_Poll() and BAUD_Tick(), or MB_Poll().
+	PROF_REPORT,	// LOG_Tick() and REPORT_Tick().
+	PROF_IDS,
+};
+
+#define PROF_TRACE_SIZE 16 // Trace entries (power of 2).
+#define PROF_TRACE_EMPTY 0xFF
+
+#if (DHT22_BACKEND == DHT22_BACKEND_ICP)
+#define PROF_CYCLES_PER_COUNT 8 // Timer1 runs at clk/8 for the driver.
+#else
+#define PROF_CYCLES_PER_COUNT PROF_PRESCALER
+#endif
+
+/* Durations of a section (Timer1 counts). */
+typedef struct
+{
+	uint16_t count; // Saturates at 0xFFFF, then sum stops too.
+	uint16_t min;
+	uint16_t max;
+	uint32_t sum;
+} PROF_STATS_t;
+
+/* Trace entry */
+typedef struct
+{
+	uint8_t id; // PROF_TRACE_EMPTY if not written yet.
+	uint16_t start; // Timer1 at PROF_BEGIN.
+	uint16_t counts; // Duration.
+} PROF_TRACE_t;
+
+#if (PROF_ENABLE == 1)
+
+extern PROF_STATS_t prof_stats[PROF_IDS];
+extern PROF_TRACE_t prof_trace[PROF_TRACE_SIZE];
+extern uint8_t prof_trace_head; // Next entry written.
+
+/* Accumulates one section. Short enough for the interrupt handlers, and
+   atomic, so the main loop tasks can call it too. */
+static inline void PROF_Add(uint8_t id, uint16_t start)
+{
+	uint16_t counts = TCNT1 - start;
+	PROF_STATS_t* s = &prof_stats[id];
+	PROF_TRACE_t* t;
+	uint8_t sreg = SREG;
+	
+	cli();
+	if (s->count != 0xFFFF){
+		if (s->count == 0 || counts < s->min) s->min = counts;
+		if (counts > s->max) s->max = counts;
+		s->sum += counts;
+		s->count++;
+	}
+	t = &prof_trace[prof_trace_head];
+	prof_trace_head = (prof_trace_head + 1) & (PROF_TRACE_SIZE - 1);
+	t->id = id;
+	t->start = start;
+	t->counts = counts;
+	SREG = sreg;
+}
+
+/* PROF_BEGIN declares a local (prof_start_<id>): use it as a statement at the
+   start of a block, not as the body of an if or a loop, and put PROF_END in the
+   same block. Each id can be opened once per block. */
+#define PROF_BEGIN(id) uint16_t prof_start_##id = TCNT1; if (id##_MASK) PROF_PORT |= (id##_MASK)
+#define PROF_END(id) do { if (id##_MASK) PROF_PORT &= ~(id##_MASK); PROF_Add(id, prof_start_##id); } while (0)
+
+void PROF_Init(void);
+void PROF_Clear(void);
+
+#else
+
+#define PROF_BEGIN(id)
+#define PROF_END(id)
+
+#endif
+
+#endif /* PROF_H_ */
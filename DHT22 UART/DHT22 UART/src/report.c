@@ -0,0 +1,413 @@
+/*
+ * report.c
+ *
+ * Output of the acquisition results to the host. See report.h.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#include "acquisition.h"
+#include "aggregate.h"
+#include "cache.h"
+#include "clock.h"
+#include "eelog.h"
+#include "filter.h"
+#include "mem.h"
+#include "frame.h"
+#include "report.h"
+#include "uart.h"
+
+#if (DHT22_SENSOR_COUNT > 16)
+#error "The delta frames have 4 bits for the sensor."
+#endif
+
+uint8_t report_format;
+uint8_t report_mode;
+REPORT_DEADBAND_t report_deadband;
+uint16_t report_aggregate_s;
+REPORT_BATCH_t report_batch;
+
+/* Last sample sent of each sensor (report by exception) */
+static uint8_t sent[DHT22_SENSOR_COUNT]; // last_xxx are valid.
+static int16_t last_temperature[DHT22_SENSOR_COUNT];
+static uint16_t last_humidity[DHT22_SENSOR_COUNT];
+static uint16_t silence[DHT22_SENSOR_COUNT]; // Ticks since the last sample sent.
+
+/* Aggregation interval */
+static uint8_t aggregate_ticks;
+static uint16_t aggregate_s;
+
+static void send_aggregate(uint8_t sensor, const AGG_t* agg);
+
+/* Batch being filled (FRAME_BATCH payload) */
+#define BATCH_ERROR 0x80 // Sensor byte of an error entry.
+#define BATCH_HEADER 5
+static uint8_t batch[BATCH_HEADER + REPORT_BATCH_MAX * 6];
+static uint8_t batch_count;
+static uint16_t ticks; // Time base of the batches.
+static uint16_t batch_base; // ticks of the first entry.
+
+/* Writes a 32 bit value, little endian. */
+static void put_u32(uint8_t* p, uint32_t value)
+{
+	p[0] = (uint8_t)value;
+	p[1] = (uint8_t)(value >> 8);
+	p[2] = (uint8_t)(value >> 16);
+	p[3] = (uint8_t)(value >> 24);
+}
+
+/* Sends the batch being filled, if any. */
+static void batch_flush(void)
+{
+	if (batch_count == 0) return;
+	batch[4] = batch_count;
+	FRAME_Send(FRAME_BATCH, batch, BATCH_HEADER + batch_count * 6);
+	batch_count = 0;
+}
+
+/* Adds an entry to the batch, sends it when full. */
+static void batch_add(uint8_t sensor, int16_t temperature, uint16_t humidity)
+{
+	uint8_t* p;
+	
+	if (batch_count && (uint16_t)(ticks - batch_base) > 0xFF) batch_flush();
+	if (batch_count == 0){
+		batch_base = ticks;
+		put_u32(batch, CLOCK_Millis());
+	}
+	p = &batch[BATCH_HEADER + batch_count * 6];
+	p[0] = sensor;
+	p[1] = (uint8_t)(ticks - batch_base);
+	p[2] = (uint8_t)temperature;
+	p[3] = (uint8_t)((uint16_t)temperature >> 8);
+	p[4] = (uint8_t)humidity;
+	p[5] = (uint8_t)(humidity >> 8);
+	if (++batch_count >= report_batch.samples) batch_flush();
+}
+
+/* Delta format: last sample sent of each sensor */
+static uint8_t delta_seq[DHT22_SENSOR_COUNT];
+static uint8_t delta_since_key[DHT22_SENSOR_COUNT]; // 0: the next sample is a key frame.
+static int16_t delta_temperature[DHT22_SENSOR_COUNT];
+static uint16_t delta_humidity[DHT22_SENSOR_COUNT];
+
+/* Sends a sample in the delta format: a key frame or the smallest delta frame. */
+static void send_delta(uint8_t sensor, const DHT22_DATA_t* data)
+{
+	int16_t dt = data->raw_temperature - delta_temperature[sensor];
+	int16_t dh = data->raw_humidity - delta_humidity[sensor];
+	uint8_t seq = ++delta_seq[sensor];
+	uint8_t payload[6];
+	
+	delta_temperature[sensor] = data->raw_temperature;
+	delta_humidity[sensor] = data->raw_humidity;
+	
+	if (delta_since_key[sensor] == 0 || dt < INT8_MIN || dt > INT8_MAX || dh < INT8_MIN || dh > INT8_MAX){
+		payload[0] = sensor;
+		payload[1] = seq;
+		payload[2] = (uint8_t)data->raw_temperature;
+		payload[3] = (uint8_t)((uint16_t)data->raw_temperature >> 8);
+		payload[4] = (uint8_t)data->raw_humidity;
+		payload[5] = (uint8_t)(data->raw_humidity >> 8);
+		FRAME_Send(FRAME_KEY, payload, 6);
+		delta_since_key[sensor] = 1;
+		return;
+	}
+	if (++delta_since_key[sensor] >= REPORT_KEY_INTERVAL) delta_since_key[sensor] = 0;
+	
+	payload[0] = (sensor << 4) | (seq & 0x0F);
+	if (dt >= -8 && dt <= 7 && dh >= -8 && dh <= 7){
+		payload[1] = ((uint8_t)dt << 4) | ((uint8_t)dh & 0x0F);
+		FRAME_Send(FRAME_DELTA4, payload, 2);
+	}
+	else{
+		payload[1] = dt;
+		payload[2] = dh;
+		FRAME_Send(FRAME_DELTA8, payload, 3);
+	}
+}
+
+/* Returns 1 if the samples and errors are batched. */
+static uint8_t batching(void)
+{
+	return report_format == REPORT_BINARY && report_batch.samples > 1;
+}
+
+void REPORT_Init(void)
+{
+	report_format = REPORT_ASCII;
+	report_mode = REPORT_STREAM;
+	report_deadband.temperature = REPORT_DEADBAND_T;
+	report_deadband.humidity = REPORT_DEADBAND_H;
+	report_deadband.heartbeat_s = REPORT_HEARTBEAT_S;
+	REPORT_SetAggregate(REPORT_AGGREGATE_S);
+	report_batch.samples = 0;
+	report_batch.latency_ms = REPORT_BATCH_MAX_LATENCY_MS;
+}
+
+/*
+ * void REPORT_SetAggregate(uint16_t interval_s)
+ *
+ * Sets the aggregation interval (0 disables it) and starts a new interval.
+ */
+void REPORT_SetAggregate(uint16_t interval_s)
+{
+	uint8_t i;
+	
+	report_aggregate_s = interval_s;
+	aggregate_ticks = 0;
+	aggregate_s = 0;
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		AGG_Clear(i);
+	}
+}
+
+/* Must be called every ACQ_TICK_MS. */
+void REPORT_Tick(void)
+{
+	uint8_t i;
+	
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		if (silence[i] < 0xFFFF) silence[i]++;
+	}
+	
+	ticks++;
+	if (batch_count && (uint16_t)(ticks - batch_base) >= ACQ_MS_TO_TICKS(report_batch.latency_ms)){
+		batch_flush();
+	}
+	
+	if (report_aggregate_s == 0 || ++aggregate_ticks < ACQ_MS_TO_TICKS(1000)) return;
+	aggregate_ticks = 0;
+	if (++aggregate_s < report_aggregate_s) return;
+	aggregate_s = 0;
+	for (i = 0; i < DHT22_SENSOR_COUNT; i++){
+		if (report_mode == REPORT_STREAM && (acq_config.enabled & (1 << i))){
+			send_aggregate(i, AGG_Get(i));
+		}
+		AGG_Clear(i);
+	}
+}
+
+/* Returns 1 if a sample must be sent (see report by exception in report.h). */
+static uint8_t sample_due(uint8_t sensor, const DHT22_DATA_t* data)
+{
+	if (report_deadband.heartbeat_s && sent[sensor] &&
+			abs(data->raw_temperature - last_temperature[sensor]) <= report_deadband.temperature &&
+			abs((int16_t)(data->raw_humidity - last_humidity[sensor])) <= report_deadband.humidity &&
+			silence[sensor] < ACQ_MS_TO_TICKS(1000UL * report_deadband.heartbeat_s)){
+		return 0;
+	}
+	sent[sensor] = 1;
+	last_temperature[sensor] = data->raw_temperature;
+	last_humidity[sensor] = data->raw_humidity;
+	silence[sensor] = 0;
+	return 1;
+}
+
+/* Acquisition callbacks (acquisition.h) */
+void ACQ_OnSample(uint8_t sensor, const DHT22_DATA_t* sample)
+{
+	DHT22_DATA_t filtered = *sample;
+	const DHT22_DATA_t* data = &filtered;
+	char str[20];
+	uint16_t t;
+	
+	FILTER_Apply(sensor, &filtered);
+	CACHE_Add(sensor, DHT_DATA_READY, data);
+	LOG_Add(sensor, DHT_DATA_READY, data);
+	if (report_aggregate_s){
+		AGG_Add(sensor, data);
+		return;
+	}
+	if (report_mode == REPORT_POLL || !sample_due(sensor, data)) return;
+	
+	if (batching()){
+		batch_add(sensor, data->raw_temperature, data->raw_humidity);
+		return;
+	}
+	if (report_format == REPORT_DELTA){
+		send_delta(sensor, data);
+		return;
+	}
+	if (report_format != REPORT_ASCII){
+		uint8_t payload[9];
+		payload[0] = sensor;
+		payload[1] = (uint8_t)data->raw_temperature;
+		payload[2] = (uint8_t)((uint16_t)data->raw_temperature >> 8);
+		payload[3] = (uint8_t)data->raw_humidity;
+		payload[4] = (uint8_t)(data->raw_humidity >> 8);
+		put_u32(&payload[5], CLOCK_Millis());
+		FRAME_Send(FRAME_SAMPLE, payload, sizeof(payload));
+		return;
+	}
+	
+	t = abs(data->raw_temperature);
+	sprintf(str,"OK,%s%u.%u,%u.%u\n",(data->raw_temperature < 0) ? "-" : "",t / 10,t % 10,
+			data->raw_humidity / 10,data->raw_humidity % 10);
+	uart_puts(str);
+}
+
+void ACQ_OnError(uint8_t sensor, DHT22_STATUS_t error)
+{
+	char err[10];
+	
+	CACHE_Add(sensor, error, NULL);
+	LOG_Add(sensor, error, NULL);
+	sent[sensor] = 0; // The next sample is sent,
+	delta_since_key[sensor] = 0; // in a key frame.
+	if (report_aggregate_s){
+		AGG_Error(sensor);
+		return;
+	}
+	if (report_mode == REPORT_POLL) return;
+	
+	if (batching()){
+		batch_add(sensor | BATCH_ERROR, error, 0);
+		return;
+	}
+	if (report_format != REPORT_ASCII){
+		uint8_t payload[2];
+		payload[0] = sensor;
+		payload[1] = error;
+		FRAME_Send(FRAME_ERROR, payload, sizeof(payload));
+		return;
+	}
+	
+	sprintf(err,"ERROR,%i\n",error);
+	uart_puts(err);
+}
+
+void ACQ_OnHealth(uint8_t sensor, const ACQ_STATS_t* stats)
+{
+	char str[20];
+	uint8_t i;
+	uint32_t asleep = CLOCK_Asleep();
+	uint32_t awake = CLOCK_Millis() - asleep;
+	MEM_STATS_t mem;
+	
+	if (report_mode == REPORT_POLL) return; // CMD_DUMP_STATS
+	
+	MEM_Get(&mem);
+	batch_flush();
+	if (report_format != REPORT_ASCII){
+		uint8_t payload[1 + sizeof(ACQ_STATS_t) + 8 + sizeof(MEM_STATS_t)];
+		payload[0] = sensor;
+		for (i = 0; i < sizeof(ACQ_STATS_t); i++){
+			payload[1 + i] = ((const uint8_t*)stats)[i]; // AVR is little endian, as the frames.
+		}
+		put_u32(&payload[1 + sizeof(ACQ_STATS_t)], awake);
+		put_u32(&payload[5 + sizeof(ACQ_STATS_t)], asleep);
+		for (i = 0; i < sizeof(MEM_STATS_t); i++){
+			payload[9 + sizeof(ACQ_STATS_t) + i] = ((const uint8_t*)&mem)[i];
+		}
+		FRAME_Send(FRAME_HEALTH, payload, sizeof(payload));
+		return;
+	}
+	
+	sprintf(str,"HEALTH,%u,%u",sensor,stats->ok);
+	uart_puts(str);
+	for (i = DHT_BUS_HUNG; i <= DHT_ERROR_CHECKSUM; i++){
+		sprintf(str,",%u",stats->err[i]);
+		uart_puts(str);
+	}
+	sprintf(str,",%u",stats->retries);
+	uart_puts(str);
+	sprintf(str,",%u",stats->lost);
+	uart_puts(str);
+	sprintf(str,",%u",stats->power_cycles);
+	uart_puts(str);
+	sprintf(str,",%lu",(unsigned long)awake);
+	uart_puts(str);
+	sprintf(str,",%lu",(unsigned long)asleep);
+	uart_puts(str);
+	sprintf(str,",%u,%u,%u\n",mem.static_bytes,mem.stack_peak,mem.free_min);
+	uart_puts(str);
+}
+
+/* Sends ",<value>" with one (scale 10) or two (scale 100) decimals. */
+static void send_value(int16_t value, uint8_t scale)
+{
+	char str[12];
+	uint16_t v = abs(value);
+	
+	sprintf(str,(scale == 10) ? ",%s%u.%u" : ",%s%u.%02u",(value < 0) ? "-" : "",v / scale,v % scale);
+	uart_puts(str);
+}
+
+static void send_aggregate(uint8_t sensor, const AGG_t* agg)
+{
+	char str[20];
+	
+	batch_flush();
+	if (report_format != REPORT_ASCII){
+		uint8_t payload[17];
+		int16_t values[6];
+		uint8_t i;
+		
+		values[0] = agg->temperature_min;
+		values[1] = agg->temperature_max;
+		values[2] = AGG_TemperatureMean(agg);
+		values[3] = agg->humidity_min;
+		values[4] = agg->humidity_max;
+		values[5] = AGG_HumidityMean(agg);
+		payload[0] = sensor;
+		payload[1] = (uint8_t)agg->count;
+		payload[2] = (uint8_t)(agg->count >> 8);
+		payload[3] = (uint8_t)agg->errors;
+		payload[4] = (uint8_t)(agg->errors >> 8);
+		for (i = 0; i < 6; i++){
+			payload[5 + 2 * i] = (uint8_t)values[i];
+			payload[6 + 2 * i] = (uint8_t)((uint16_t)values[i] >> 8);
+		}
+		FRAME_Send(FRAME_AGGREGATE, payload, sizeof(payload));
+		return;
+	}
+	
+	sprintf(str,"AGG,%u,%u,%u",sensor,agg->count,agg->errors);
+	uart_puts(str);
+	send_value(agg->temperature_min, 10);
+	send_value(agg->temperature_max, 10);
+	send_value(AGG_TemperatureMean(agg), 100);
+	send_value(agg->humidity_min, 10);
+	send_value(agg->humidity_max, 10);
+	send_value(AGG_HumidityMean(agg), 100);
+	uart_putc('\n');
+}
+
+#if (DHT22_HISTOGRAM == 1)
+/*
+ * void REPORT_Histograms(void)
+ *
+ * Sends the pulse width histograms, one line (or frame) per sensor and pulse kind.
+ */
+void REPORT_Histograms(void)
+{
+	char str[10];
+	uint8_t sensor, kind, n;
+	
+	batch_flush();
+	for (sensor = 0; sensor < DHT22_SENSOR_COUNT; sensor++){
+		for (kind = 0; kind < DHT_HIST_KINDS; kind++){
+			if (report_format != REPORT_ASCII){
+				uint8_t payload[2 + 2 * DHT22_HIST_BINS];
+				payload[0] = sensor;
+				payload[1] = kind;
+				for (n = 0; n < DHT22_HIST_BINS; n++){
+					payload[2 + 2 * n] = (uint8_t)dht22_hist[sensor].bin[kind][n];
+					payload[3 + 2 * n] = (uint8_t)(dht22_hist[sensor].bin[kind][n] >> 8);
+				}
+				FRAME_Send(FRAME_HIST, payload, sizeof(payload));
+				continue;
+			}
+			sprintf(str,"HIST,%u,%u",sensor,kind);
+			uart_puts(str);
+			for (n = 0; n < DHT22_HIST_BINS; n++){
+				sprintf(str,",%u",dht22_hist[sensor].bin[kind][n]);
+				uart_puts(str);
+			}
+			uart_putc('\n');
+		}
+	}
+}
+#endif
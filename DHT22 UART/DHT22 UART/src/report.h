@@ -0,0 +1,109 @@
+/*
+ * report.h
+ *
+ * Output of the acquisition results to the host, in ASCII or binary
+ * format (see frame.h). Implements the callbacks of acquisition.h.
+ *
+ * ASCII format (one line each):
+ *   OK,<temperature>,<humidity>
+ *   ERROR,<error>
+ *   HEALTH,<sensor>,<ok>,<bus hung>,<not present>,<ack too long>,<sync timeout>,
+ *          <data timeout>,<checksum>,<retries>,<lost>,<power cycles>,
+ *          <awake (ms)>,<asleep (ms)>,<static RAM>,<stack peak>,<free RAM min> (bytes, mem.h)
+ *   HIST,<sensor>,<kind>,<bin 0>,...,<bin 31>
+ *   AGG,<sensor>,<count>,<errors>,<temperature min>,<max>,<mean>,<humidity min>,<max>,<mean>
+ * Binary format: FRAME_SAMPLE, FRAME_ERROR, FRAME_HEALTH, FRAME_HIST,
+ * FRAME_AGGREGATE and FRAME_BATCH frames.
+ * Delta format: as the binary format, but the samples are sent as a key
+ * frame (FRAME_KEY, full values) every REPORT_KEY_INTERVAL samples of a
+ * sensor, and as deltas to the previous sample in between: FRAME_DELTA4
+ * (both deltas within -8..7, 8 bytes on the wire with the sync, type, len,
+ * seq and CRC, against 15 for FRAME_SAMPLE) or FRAME_DELTA8 (within
+ * -128..127, 9 bytes). A larger change or an error makes the next sample a
+ * key frame (12 bytes).
+ * The 4 bit sequence number of each sensor lets the host detect a lost
+ * frame and wait for the next key frame.
+ *
+ * In stream mode (default) every result is sent as soon as it is available.
+ * In poll mode nothing is sent on its own: the results are kept in the cache
+ * (cache.h) and the host reads them with commands (command.h), so several
+ * devices can share one link and only the data that is used is sent.
+ *
+ * Report by exception (stream mode): with a heartbeat set, a sample is only
+ * sent when the temperature or the humidity moved more than its deadband
+ * from the last sample sent, or when nothing was sent for the heartbeat
+ * period. The first sample and the sample after an error are always sent.
+ * The host holds the last value until the next one (step-hold). Errors
+ * are always sent, and the cache and the EEPROM log get every sample.
+ *
+ * Aggregation (stream mode): with an interval set, the samples and errors
+ * are not sent but accumulated (aggregate.h), and every interval one
+ * aggregate record is sent for each enabled sensor. The means have one
+ * more decimal than the samples.
+ *
+ * Batching (stream mode, binary format): with report_batch.samples above 1,
+ * the samples and errors to send are packed into FRAME_BATCH frames, with a
+ * shared header and time base (clock.h). A batch is sent when it has
+ * report_batch.samples entries, when its first entry is report_batch.latency_ms
+ * old, or before any other frame (so the order is kept).
+ */
+
+#ifndef REPORT_H_
+#define REPORT_H_
+
+#include <stdint.h>
+
+#include "frame.h"
+
+/* Output formats */
+#define REPORT_ASCII 0
+#define REPORT_BINARY 1
+#define REPORT_DELTA 2
+
+#define REPORT_KEY_INTERVAL 16 // Samples per key frame (delta format).
+
+/* Modes */
+#define REPORT_STREAM 0
+#define REPORT_POLL 1
+
+/* Report by exception defaults */
+#define REPORT_DEADBAND_T 2 // 0.1 C
+#define REPORT_DEADBAND_H 5 // 0.1 %
+#define REPORT_HEARTBEAT_S 0 // Maximum silence (s). 0 sends every sample.
+#define REPORT_MAX_HEARTBEAT_S 600
+
+/* Aggregation */
+#define REPORT_AGGREGATE_S 0 // Interval (s). 0 sends the samples.
+#define REPORT_MAX_AGGREGATE_S 3600
+
+/* Batching */
+#define REPORT_BATCH_MAX ((FRAME_MAX_PAYLOAD - 5) / 6) // Entries per FRAME_BATCH.
+#define REPORT_BATCH_MAX_LATENCY_MS 2000 // The entry offsets are 8 bit ticks.
+
+/* Report by exception configuration */
+typedef struct
+{
+	uint16_t temperature; // Deadband (0.1 C)
+	uint16_t humidity; // Deadband (0.1 %)
+	uint16_t heartbeat_s; // 0 disables report by exception.
+} REPORT_DEADBAND_t;
+
+/* Batching configuration */
+typedef struct
+{
+	uint8_t samples; // Entries per batch, 0 or 1 disables batching.
+	uint16_t latency_ms; // Maximum age of the first entry.
+} REPORT_BATCH_t;
+
+extern uint8_t report_format;
+extern uint8_t report_mode;
+extern REPORT_DEADBAND_t report_deadband;
+extern uint16_t report_aggregate_s;
+extern REPORT_BATCH_t report_batch;
+
+void REPORT_Init(void);
+void REPORT_Tick(void);
+void REPORT_SetAggregate(uint16_t interval_s);
+void REPORT_Histograms(void);
+
+#endif /* REPORT_H_ */
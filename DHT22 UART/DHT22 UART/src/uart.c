@@ -92,6 +92,7 @@ Date        Description
 #include <avr/interrupt.h>
 #include <avr/pgmspace.h>
 #include "uart.h"
+#include "prof.h"
 
 
 /*
@@ -325,6 +326,7 @@ Purpose:  called when the UART has received a character
     unsigned char usr;
     unsigned char lastRxError;
  
+    PROF_BEGIN(PROF_UART_RX);
  
     /* read UART status register and UART data register */ 
     usr  = UART0_STATUS;
@@ -336,7 +338,7 @@ Purpose:  called when the UART has received a character
 #elif defined( ATMEGA_USART )
     lastRxError = (usr & (_BV(FE)|_BV(DOR)) );
 #elif defined( ATMEGA_USART0 )
-    lastRxError = (usr & (_BV(FE0)|_BV(DOR0)) );
+    lastRxError = (usr & (_BV(FE0)|_BV(DOR0)|_BV(UPE0)) );
 #elif defined ( ATMEGA_UART )
     lastRxError = (usr & (_BV(FE)|_BV(DOR)) );
 #endif
@@ -354,6 +356,7 @@ Purpose:  called when the UART has received a character
         UART_RxBuf[tmphead] = data;
     }
     UART_LastRxError = lastRxError;   
+    PROF_END(PROF_UART_RX);
 }
 
 
@@ -365,6 +368,7 @@ Purpose:  called when the UART is ready to transmit the next byte
 {
     unsigned char tmptail;
 
+    PROF_BEGIN(PROF_UART_TX);
     
     if ( UART_TxHead != UART_TxTail) {
         /* calculate and store new buffer index */
@@ -376,6 +380,7 @@ Purpose:  called when the UART is ready to transmit the next byte
         /* tx buffer empty, disable UDRE interrupt */
         UART0_CONTROL &= ~_BV(UART0_UDRIE);
     }
+    PROF_END(PROF_UART_TX);
 }
 
 
@@ -426,6 +431,10 @@ void uart_init(unsigned int baudrate)
    		UART0_STATUS = (1<<U2X0);  //Enable 2x speed 
    		baudrate &= ~0x8000;
    	}
+    else
+    {
+        UART0_STATUS = 0;  //Normal speed (clear U2X0 of a previous init)
+    }
     UBRR0H = (unsigned char)(baudrate>>8);
     UBRR0L = (unsigned char) baudrate;
 
@@ -583,6 +592,7 @@ Purpose:  called when the UART1 has received a character
     unsigned char usr;
     unsigned char lastRxError;
  
+    PROF_BEGIN(PROF_UART_RX);
  
     /* read UART status register and UART data register */ 
     usr  = UART1_STATUS;
@@ -604,6 +614,7 @@ Purpose:  called when the UART1 has received a character
         UART1_RxBuf[tmphead] = data;
     }
     UART1_LastRxError = lastRxError;   
+    PROF_END(PROF_UART_RX);
 }
 
 
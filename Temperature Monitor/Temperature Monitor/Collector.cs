@@ -0,0 +1,547 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.IO.Ports;
+using System.Threading;
+
+namespace Temperature_Monitor
+{
+    /// <summary>
+    /// Collector of many devices, one serial port each, without a thread per port: every port
+    /// has one asynchronous read pending on its stream (overlapped I/O, the callbacks run on the
+    /// I/O completion threads) and its own parser, delta decoder, clock synchronization and
+    /// statistics. One timer synchronizes the clocks, writes the statistics and reopens the
+    /// ports that failed, another one sends again the setup commands not acknowledged yet.
+    /// The read callbacks and the timers of a device are serialized by its lock.
+    /// Run "Temperature Monitor.exe /collect [/baud rate] [ports]": the samples of all devices
+    /// are appended to samples.csv and the statistics written to collect.txt each StatsPeriod.
+    /// Without ports, the devices are found among all the ports (Discovery) and named by their id.
+    /// When a port is opened the EEPROM log of the device is dumped and the samples it stored
+    /// while nobody read it (after the last sample in samples.csv, before the first new one) are
+    /// appended too, so the rows are in arrival order, not in time order. logstate.csv keeps,
+    /// per device, the time of its last sample and the clock of its last reset seen, for the
+    /// next run.
+    /// </summary>
+    public class Collector : IDisposable
+    {
+        public const int DefaultBaud = 9600;
+        const int StatsPeriod = 60000; // ms, also the clock synchronization period
+        const int RetryPeriod = 1000; // ms, setup commands sent again until acknowledged (command.h)
+        const int ReadSize = 512;
+
+        /// <summary>
+        /// A device and its state. The counters are updated by its read callbacks, the state and
+        /// the counters are only used under Lock.
+        /// </summary>
+        public class Device
+        {
+            public object Lock = new object();
+            public string Port;
+            public string Id; // Device id (Discovery), or the port name
+            public int Baud;
+            public Protocol.Identity Identity; // null if the device was not probed
+            public bool Open;
+            public int Reopens;
+            public long Bytes;
+            public int Samples;
+            public int Errors; // Failed readings reported by the device
+            public int Backfilled; // Samples and errors taken from the device log
+            public int Undated; // Samples of the device log stored in a reset whose clock is unknown
+            public int BadLines;
+            public DateTime LastSeen;
+            public int HealthOk, HealthRetries, HealthLost; // Last health record of sensor 0
+            public bool FormatSet, ModeSet; // Setup commands answered since the port was opened
+            public int SetupRetries;
+
+            public SerialPort Serial;
+            public Protocol Protocol;
+            public Protocol.DeltaDecoder Delta;
+            public TimeSync Sync;
+            public byte[] Buffer = new byte[ReadSize];
+            public object SendLock = new object();
+
+            // Backfill from the device log, see FrameReceived (samplesLock)
+            public DateTime Written; // Time of the last sample in samples.csv
+            public DateTime GapEnd; // First sample written since the port was opened
+            public List<Protocol.LogSample> Log = new List<Protocol.LogSample>();
+            public Protocol.LogDump Clock; // Last dump reply, dates the samples of its reset
+            public DateTime ClockTime; // When it was received
+        }
+
+        const string StateFile = "logstate.csv";
+
+        List<Device> devices = new List<Device>();
+        StreamWriter samples;
+        object samplesLock = new object();
+        Dictionary<string, string[]> state = new Dictionary<string, string[]>(); // StateFile by device id
+        Timer timer, retryTimer;
+
+        public Collector()
+        {
+            samples = File.AppendText("samples.csv");
+            if (File.Exists(StateFile))
+            {
+                foreach (string line in File.ReadAllLines(StateFile))
+                {
+                    string[] data = line.Split(',');
+                    if (data.Length == 5)
+                        state[data[0]] = data;
+                }
+            }
+            timer = new Timer(Tick, null, StatsPeriod, StatsPeriod);
+            retryTimer = new Timer(Retry, null, RetryPeriod, RetryPeriod);
+        }
+
+        public List<Device> Devices
+        {
+            get { lock (devices) return new List<Device>(devices); }
+        }
+
+        /// <summary>
+        /// Adds the device at a port and opens it. A port that cannot be opened is tried
+        /// again at each StatsPeriod. identity is the one found by Discovery, or null.
+        /// </summary>
+        public Device Add(string port, int baud, Protocol.Identity identity)
+        {
+            Device d = new Device();
+            d.Port = port;
+            d.Id = identity != null ? identity.Id.ToString("X8") : port;
+            d.Baud = baud;
+            d.Identity = identity;
+            LoadState(d);
+            lock (devices)
+                devices.Add(d);
+            lock (d.Lock)
+                Open(d);
+            return d;
+        }
+
+        // Under d.Lock. The new port and its parser are ready before they replace the old ones.
+        void Open(Device d)
+        {
+            SerialPort serial;
+            try
+            {
+                serial = new SerialPort(d.Port, d.Baud, Parity.None, 8, StopBits.One);
+                serial.Open();
+            }
+            catch (Exception)
+            {
+                return;
+            }
+            Protocol protocol = new Protocol();
+            protocol.FrameReceived += (type, payload) => FrameReceived(d, type, payload);
+            protocol.LineReceived += line => LineReceived(d, line);
+            protocol.SendRequested += frame => Send(d, frame);
+            lock (samplesLock)
+            {
+                d.GapEnd = DateTime.MaxValue;
+                d.Log.Clear();
+            }
+            d.Serial = serial;
+            d.Protocol = protocol;
+            d.Delta = new Protocol.DeltaDecoder();
+            d.Sync = new TimeSync();
+            d.Buffer = new byte[ReadSize];
+            d.FormatSet = d.Identity != null && (d.Identity.Formats & (1 << Protocol.FormatBinary)) == 0;
+            d.ModeSet = false;
+            d.Open = true;
+            BeginRead(d, serial);
+
+            // Binary frames (CRC, retransmission) if supported, and the first synchronization round
+            SendSetup(d);
+            Send(d, d.Sync.Start());
+            Send(d, Protocol.DumpLog());
+        }
+
+        void SendSetup(Device d)
+        {
+            if (!d.FormatSet)
+                Send(d, Protocol.SetFormat(Protocol.FormatBinary));
+            if (!d.ModeSet)
+                Send(d, Protocol.SetMode(Protocol.ModeStream));
+        }
+
+        // Closes a port of the device, which is closed if it is still the current one
+        void Close(Device d, SerialPort serial)
+        {
+            try
+            {
+                serial.Close();
+            }
+            catch (Exception)
+            {
+                // Already gone (unplugged)
+            }
+            lock (d.Lock)
+            {
+                if (d.Serial == serial)
+                    d.Open = false;
+            }
+        }
+
+        void BeginRead(Device d, SerialPort serial)
+        {
+            byte[] buffer = d.Buffer;
+            try
+            {
+                serial.BaseStream.BeginRead(buffer, 0, buffer.Length, result => ReadDone(d, serial, buffer, result), null);
+            }
+            catch (Exception)
+            {
+                Close(d, serial);
+            }
+        }
+
+        // Read callback: at most one per port at a time
+        void ReadDone(Device d, SerialPort serial, byte[] buffer, IAsyncResult result)
+        {
+            int count;
+            try
+            {
+                count = serial.BaseStream.EndRead(result);
+            }
+            catch (Exception)
+            {
+                Close(d, serial);
+                return;
+            }
+            if (count > 0)
+            {
+                lock (d.Lock)
+                {
+                    if (d.Serial != serial)
+                        return;
+                    d.Bytes += count;
+                    d.LastSeen = DateTime.Now;
+                    d.Protocol.Feed(buffer, count);
+                }
+            }
+            BeginRead(d, serial);
+        }
+
+        void Send(Device d, byte[] frame)
+        {
+            lock (d.SendLock)
+            {
+                try
+                {
+                    d.Serial.BaseStream.Write(frame, 0, frame.Length);
+                }
+                catch (Exception)
+                {
+                    // The read callback closes the port
+                }
+            }
+        }
+
+        void FrameReceived(Device d, byte type, byte[] payload)
+        {
+            switch (type)
+            {
+                case Protocol.FrameSample:
+                    WriteSample(d, payload[0], 0, BitConverter.ToInt16(payload, 1) / 10.0f,
+                        BitConverter.ToUInt16(payload, 3) / 10.0f, DeviceTime(d, BitConverter.ToUInt32(payload, 5)));
+                    break;
+                case Protocol.FrameError:
+                    WriteSample(d, payload[0], payload[1], 0, 0, DateTime.Now);
+                    break;
+                case Protocol.FrameBatch:
+                    foreach (Protocol.BatchEntry e in Protocol.ParseBatch(payload))
+                        WriteSample(d, e.Sensor, e.Status, e.Temperature, e.Humidity, DeviceTime(d, e.Time));
+                    break;
+                case Protocol.FrameKey:
+                case Protocol.FrameDelta4:
+                case Protocol.FrameDelta8:
+                    int sensor;
+                    float t, h;
+                    if (d.Delta.Decode(type, payload, out sensor, out t, out h))
+                        WriteSample(d, sensor, 0, t, h, DateTime.Now);
+                    break;
+                case Protocol.FrameHealth:
+                    if (payload[0] == 0)
+                    {
+                        d.HealthOk = BitConverter.ToUInt16(payload, 1);
+                        d.HealthRetries = BitConverter.ToUInt16(payload, 17);
+                        d.HealthLost = BitConverter.ToUInt16(payload, 19);
+                    }
+                    break;
+                case Protocol.FrameReply | Protocol.CmdSetFormat:
+                    d.FormatSet = true; // An error means the format is not supported, ASCII is kept
+                    break;
+                case Protocol.FrameReply | Protocol.CmdSetMode:
+                    d.ModeSet = true;
+                    break;
+                case Protocol.FrameReply | Protocol.CmdTimeSync:
+                    byte[] next = d.Sync.Reply(payload, TimeSync.HostMs);
+                    if (next != null)
+                        Send(d, next);
+                    break;
+                case Protocol.FrameLog:
+                    lock (samplesLock)
+                        d.Log.AddRange(Protocol.ParseLog(payload));
+                    break;
+                case Protocol.FrameReply | Protocol.CmdDumpLog:
+                    Backfill(d, Protocol.ParseLogDump(payload), DateTime.Now);
+                    break;
+            }
+        }
+
+        /// <summary>
+        /// Writes the samples of the dumped log that fall in the gap: after the last sample written
+        /// before the port was opened and before the first one written since. The samples of the
+        /// current reset are dated with the clock in the reply, those of the previous one with the
+        /// clock of the previous dump, the older ones are dropped (Undated).
+        /// </summary>
+        void Backfill(Device d, Protocol.LogDump dump, DateTime received)
+        {
+            if (dump == null)
+                return;
+            lock (samplesLock)
+            {
+                DateTime start = d.Written;
+                if (d.GapEnd == DateTime.MaxValue)
+                    d.GapEnd = received;
+                foreach (Protocol.LogSample s in d.Log)
+                {
+                    DateTime time;
+                    if (s.Boot == dump.Boot)
+                        time = dump.TimeOf(s, received);
+                    else if (d.Clock != null && s.Boot == d.Clock.Boot)
+                        time = d.Clock.TimeOf(s, d.ClockTime);
+                    else
+                    {
+                        d.Undated++;
+                        continue;
+                    }
+                    if (time > start && time < d.GapEnd)
+                    {
+                        d.Backfilled++;
+                        WriteSample(d, s.Sensor, s.Status, s.Temperature, s.Humidity, time);
+                    }
+                }
+                d.Log.Clear();
+                d.Clock = dump;
+                d.ClockTime = received;
+            }
+        }
+
+        void LineReceived(Device d, string line)
+        {
+            // Until the device takes the binary format. The ASCII lines carry no sensor
+            // index (report.c), so they are only kept from a device known to have one sensor.
+            string[] data = line.Split(',');
+            if ((data[0] == "OK" || data[0] == "ERROR") && (d.Identity == null || d.Identity.Sensors != 1))
+            {
+                d.BadLines++;
+                return;
+            }
+            try
+            {
+                if (data[0] == "OK")
+                    WriteSample(d, 0, 0, float.Parse(data[1], CultureInfo.InvariantCulture),
+                        float.Parse(data[2], CultureInfo.InvariantCulture), DateTime.Now);
+                else if (data[0] == "ERROR")
+                    WriteSample(d, 0, byte.Parse(data[1]), 0, 0, DateTime.Now);
+            }
+            catch (FormatException)
+            {
+                d.BadLines++;
+            }
+            catch (IndexOutOfRangeException)
+            {
+                d.BadLines++;
+            }
+        }
+
+        static DateTime DeviceTime(Device d, uint deviceMs)
+        {
+            double hostMs, bound;
+            if (!d.Sync.ToHost(deviceMs, out hostMs, out bound))
+                return DateTime.Now;
+            return TimeSync.WallClock(hostMs);
+        }
+
+        /// <summary>
+        /// Appends a sample to samples.csv: time,device,sensor,status,temperature,humidity.
+        /// </summary>
+        void WriteSample(Device d, int sensor, int status, float t, float h, DateTime time)
+        {
+            if (status == 0)
+                d.Samples++;
+            else
+                d.Errors++;
+            lock (samplesLock)
+            {
+                samples.Write(String.Format(CultureInfo.InvariantCulture, "{0:yyyy-MM-dd HH:mm:ss.fff},{1},{2},{3},{4},{5}\r\n",
+                    time, d.Id, sensor, status, t, h));
+                if (d.GapEnd == DateTime.MaxValue)
+                    d.GapEnd = time;
+                if (time > d.Written)
+                    d.Written = time;
+            }
+        }
+
+        /// <summary>
+        /// Reads the state of a device from the previous run: id, time of its last sample,
+        /// reset counter, device clock and wall time of its last dump reply.
+        /// </summary>
+        void LoadState(Device d)
+        {
+            string[] data;
+            if (!state.TryGetValue(d.Id, out data))
+                return;
+            try
+            {
+                d.Written = new DateTime(long.Parse(data[1]));
+                long clockTime = long.Parse(data[4]);
+                if (clockTime != 0)
+                {
+                    d.Clock = new Protocol.LogDump();
+                    d.Clock.Boot = byte.Parse(data[2]);
+                    d.Clock.Now = uint.Parse(data[3]);
+                    d.ClockTime = new DateTime(clockTime);
+                }
+            }
+            catch (FormatException)
+            {
+                // Starts without a state
+            }
+            catch (OverflowException)
+            {
+            }
+        }
+
+        void SaveState()
+        {
+            lock (samplesLock)
+            {
+                foreach (Device d in Devices)
+                {
+                    state[d.Id] = new string[] { d.Id, d.Written.Ticks.ToString(),
+                        d.Clock != null ? d.Clock.Boot.ToString() : "0", d.Clock != null ? d.Clock.Now.ToString() : "0",
+                        d.Clock != null ? d.ClockTime.Ticks.ToString() : "0" };
+                }
+                using (StreamWriter w = new StreamWriter(StateFile))
+                {
+                    foreach (string[] data in state.Values)
+                        w.WriteLine(String.Join(",", data));
+                }
+            }
+        }
+
+        void Tick(object o)
+        {
+            lock (samplesLock)
+                samples.Flush();
+            SaveState();
+            foreach (Device d in Devices)
+            {
+                lock (d.Lock)
+                {
+                    if (!d.Open)
+                    {
+                        d.Reopens++;
+                        Open(d);
+                    }
+                    else
+                    {
+                        Send(d, d.Sync.Start());
+                    }
+                }
+            }
+            using (StreamWriter w = new StreamWriter("collect.txt"))
+                WriteStats(w);
+        }
+
+        /// <summary>
+        /// Writes one line per device: id, port, state, bytes, samples, errors (both with the backfilled
+        /// ones), backfilled, undated, setup commands sent again, link counters
+        /// (corrupted, recovered, lost frames, lost deltas, bad lines, which include the ASCII samples
+        /// skipped because their sensor is not known), last health record of
+        /// sensor 0 (ok, retries, lost), clock drift (ppm) and the last time data arrived.
+        /// </summary>
+        public void WriteStats(TextWriter w)
+        {
+            w.WriteLine("{0:g} - {1} devices", DateTime.Now, devices.Count);
+            foreach (Device d in Devices)
+            {
+                lock (d.Lock)
+                {
+                    Protocol p = d.Protocol;
+                    w.WriteLine(String.Format(CultureInfo.InvariantCulture,
+                        "{0},{1},{2},{3},{4},{5},{6},{7},{8},{9},{10},{11},{12},{13},{14},{15},{16},{17:F1},{18:yyyy-MM-dd HH:mm:ss}",
+                        d.Id, d.Port, d.Open ? "open" : "closed (" + d.Reopens + " reopens)", d.Bytes, d.Samples, d.Errors,
+                        d.Backfilled, d.Undated, d.SetupRetries,
+                        p != null ? p.Corrupted : 0, p != null ? p.Recovered : 0, p != null ? p.Lost : 0,
+                        d.Delta != null ? d.Delta.Lost : 0, d.BadLines, d.HealthOk, d.HealthRetries, d.HealthLost,
+                        d.Sync != null ? d.Sync.DriftPpm : 0, d.LastSeen));
+                }
+            }
+        }
+
+        /// <summary>
+        /// Sends again the setup commands of the open devices that did not answer them.
+        /// </summary>
+        void Retry(object o)
+        {
+            foreach (Device d in Devices)
+            {
+                lock (d.Lock)
+                {
+                    if (d.Open && (!d.FormatSet || !d.ModeSet))
+                    {
+                        d.SetupRetries++;
+                        SendSetup(d);
+                    }
+                }
+            }
+        }
+
+        public void Dispose()
+        {
+            timer.Dispose();
+            retryTimer.Dispose();
+            foreach (Device d in Devices)
+            {
+                SerialPort serial;
+                lock (d.Lock)
+                    serial = d.Open ? d.Serial : null;
+                if (serial != null)
+                    Close(d, serial);
+            }
+            SaveState();
+            lock (samplesLock)
+                samples.Close();
+        }
+
+        /// <summary>
+        /// Runs the collector on the ports in args, or on the devices found, until the process ends.
+        /// </summary>
+        public static void Run(string[] args)
+        {
+            int rate = DefaultBaud;
+            List<string> ports = new List<string>();
+            for (int n = 1; n < args.Length; n++)
+            {
+                if (args[n] == "/baud" && n + 1 < args.Length)
+                    rate = int.Parse(args[++n]);
+                else
+                    ports.Add(args[n]);
+            }
+            Collector collector = new Collector();
+            if (ports.Count > 0)
+            {
+                foreach (string port in ports)
+                    collector.Add(port, rate, null);
+            }
+            else
+            {
+                foreach (Discovery.Found f in Discovery.Find(SerialPort.GetPortNames(), Discovery.Budget))
+                    collector.Add(f.Port, f.Baud, f.Identity);
+            }
+            Thread.Sleep(Timeout.Infinite);
+        }
+    }
+}
@@ -0,0 +1,266 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO.Ports;
+using System.Threading;
+
+namespace Temperature_Monitor
+{
+    /// <summary>
+    /// Finds the devices among the serial ports: all the ports are probed at the same time with
+    /// CmdIdentify, each at the rates a device can be at (it starts at DefaultBaud and stays at a
+    /// negotiated rate until reset), so the discovery takes at most Budget whatever the number of
+    /// ports. Each port is opened on its own thread, an open that blocks (some drivers take
+    /// seconds) delays no other port. A device without an id gets one (CmdSetId, sent again
+    /// every SetIdRetryMs until confirmed or AttemptMs). The ports are closed afterwards.
+    /// </summary>
+    public class Discovery
+    {
+        public const int Budget = 2000; // ms
+        const int AttemptMs = 300; // Per rate, the reply takes about 60 ms at 9600 baud
+        const int SetIdRetryMs = 100;
+        static readonly int[] Rates = { Collector.DefaultBaud, 1000000, 500000, 250000, 57600 };
+
+        /// <summary>A device found: its port, the rate it answered at and its identity.</summary>
+        public class Found
+        {
+            public string Port;
+            public int Baud;
+            public Protocol.Identity Identity;
+        }
+
+        class Probe
+        {
+            public string Port;
+            public SerialPort Serial;
+            public Protocol Protocol;
+            public byte[] Buffer = new byte[256];
+            public int Rate; // Index in Rates
+            public Timer Timer;
+            public Found Result;
+            public Protocol.Identity NewId; // Identity with the id sent by CmdSetId, until confirmed
+            public int Deadline; // Environment.TickCount when CmdSetId is given up
+            public bool Done;
+        }
+
+        CountdownEvent pending;
+
+        /// <summary>
+        /// Probes the ports and returns the devices that answered within budgetMs.
+        /// </summary>
+        public static List<Found> Find(string[] ports, int budgetMs)
+        {
+            Discovery discovery = new Discovery();
+            List<Probe> probes = new List<Probe>();
+            discovery.pending = new CountdownEvent(ports.Length);
+            foreach (string port in ports)
+            {
+                Probe p = new Probe();
+                p.Port = port;
+                probes.Add(p);
+                Thread thread = new Thread(discovery.Start); // Opening a port can take a while
+                thread.IsBackground = true;
+                thread.Name = "Discovery " + port;
+                thread.Start(p);
+            }
+            discovery.pending.Wait(budgetMs);
+
+            List<Found> found = new List<Found>();
+            foreach (Probe p in probes)
+            {
+                discovery.Finish(p);
+                lock (p)
+                {
+                    if (p.Result != null && p.Result.Identity != null)
+                        found.Add(p.Result);
+                }
+            }
+            return found;
+        }
+
+        void Start(object state)
+        {
+            Probe p = (Probe)state;
+            try
+            {
+                p.Serial = new SerialPort(p.Port, Rates[0], Parity.None, 8, StopBits.One);
+                p.Serial.Open();
+            }
+            catch (Exception)
+            {
+                Finish(p); // Busy or not a serial port
+                return;
+            }
+            p.Protocol = new Protocol();
+            p.Protocol.FrameReceived += (type, payload) => FrameReceived(p, type, payload);
+            lock (p)
+            {
+                if (p.Done)
+                {
+                    p.Serial.Close();
+                    return;
+                }
+                p.Timer = new Timer(AttemptTimeout, p, AttemptMs, Timeout.Infinite);
+            }
+            BeginRead(p);
+            Send(p, Protocol.Identify());
+        }
+
+        void BeginRead(Probe p)
+        {
+            try
+            {
+                p.Serial.BaseStream.BeginRead(p.Buffer, 0, p.Buffer.Length, ReadDone, p);
+            }
+            catch (Exception)
+            {
+                Finish(p);
+            }
+        }
+
+        void ReadDone(IAsyncResult result)
+        {
+            Probe p = (Probe)result.AsyncState;
+            int count;
+            try
+            {
+                count = p.Serial.BaseStream.EndRead(result);
+            }
+            catch (Exception)
+            {
+                Finish(p);
+                return;
+            }
+            p.Protocol.Feed(p.Buffer, count);
+            BeginRead(p);
+        }
+
+        static void Send(Probe p, byte[] frame)
+        {
+            try
+            {
+                p.Serial.BaseStream.Write(frame, 0, frame.Length);
+            }
+            catch (Exception)
+            {
+                // Closed, the read fails too
+            }
+        }
+
+        void FrameReceived(Probe p, byte type, byte[] payload)
+        {
+            if (type == (Protocol.FrameReply | Protocol.CmdSetId))
+            {
+                if (payload.Length == 0 || payload[0] != Protocol.CmdOk)
+                    return;
+                lock (p)
+                {
+                    if (p.Done || p.NewId == null)
+                        return;
+                    p.Result.Identity = p.NewId;
+                }
+                Finish(p);
+            }
+            else if (type == (Protocol.FrameReply | Protocol.CmdIdentify))
+            {
+                Protocol.Identity identity = Protocol.Identity.FromReply(payload);
+                if (identity == null)
+                    return;
+                lock (p)
+                {
+                    if (p.Done || p.Result != null)
+                        return;
+                    p.Result = new Found();
+                    p.Result.Port = p.Port;
+                    p.Result.Baud = Rates[p.Rate];
+                    p.Timer.Change(Timeout.Infinite, Timeout.Infinite);
+                }
+                if (identity.Id != Protocol.Identity.NoId)
+                {
+                    lock (p)
+                        p.Result.Identity = identity;
+                    Finish(p);
+                    return;
+                }
+                // New device: an id from a GUID, kept once the device confirms it. The command
+                // or its reply can be lost: sent again until the attempt times out.
+                do
+                {
+                    identity.Id = BitConverter.ToUInt32(Guid.NewGuid().ToByteArray(), 0);
+                } while (identity.Id == Protocol.Identity.NoId);
+                lock (p)
+                {
+                    if (p.Done)
+                        return;
+                    p.NewId = identity;
+                    p.Deadline = Environment.TickCount + AttemptMs;
+                    p.Timer.Change(SetIdRetryMs, Timeout.Infinite);
+                }
+                Send(p, Protocol.SetId(identity.Id));
+            }
+        }
+
+        // No reply at this rate: the next one. Waiting for CmdSetId: sends it again.
+        void AttemptTimeout(object state)
+        {
+            Probe p = (Probe)state;
+            Protocol.Identity newId;
+            bool last;
+            lock (p)
+            {
+                if (p.Done)
+                    return;
+                newId = p.NewId;
+                if (newId != null)
+                {
+                    last = Environment.TickCount - p.Deadline >= 0;
+                    if (!last)
+                        p.Timer.Change(SetIdRetryMs, Timeout.Infinite);
+                }
+                else
+                {
+                    last = ++p.Rate >= Rates.Length;
+                    if (!last)
+                    {
+                        try
+                        {
+                            p.Serial.BaudRate = Rates[p.Rate];
+                        }
+                        catch (Exception)
+                        {
+                            return; // Closed
+                        }
+                        p.Timer.Change(AttemptMs, Timeout.Infinite);
+                    }
+                }
+            }
+            if (last)
+                Finish(p); // Without a confirmed id the device is not kept, it gets one next time
+            else if (newId != null)
+                Send(p, Protocol.SetId(newId.Id));
+            else
+                Send(p, Protocol.Identify());
+        }
+
+        void Finish(Probe p)
+        {
+            lock (p)
+            {
+                if (p.Done)
+                    return;
+                p.Done = true;
+                if (p.Timer != null)
+                    p.Timer.Dispose();
+            }
+            try
+            {
+                if (p.Serial != null)
+                    p.Serial.Close();
+            }
+            catch (Exception)
+            {
+                // Already gone
+            }
+            pending.Signal();
+        }
+    }
+}
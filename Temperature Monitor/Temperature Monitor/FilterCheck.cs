@@ -0,0 +1,184 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+
+namespace Temperature_Monitor
+{
+    /// <summary>
+    /// Checks the integer arithmetic of the sample filter of the firmware (filter.c) against a
+    /// floating point reference, on synthetic signals over the whole range of the sensor.
+    /// Run "Temperature Monitor.exe /filter [/limit units]": the largest error of each
+    /// configuration (median 1, 3, 5 and a set of alphas) is written to filter.txt, in raw units
+    /// (0.1 C, 0.1 %), with FAIL on the ones above the limit (1 unit by default).
+    ///
+    /// The model follows filter.c for one quantity of one sensor: the history ring seeded with
+    /// the first sample, the insertion sort median and the EWMA kept with 8 fractional bits.
+    /// The reference takes the median of the last samples (the first one repeated before the
+    /// start) and runs y += alpha / 256 * (x - y) in double.
+    /// </summary>
+    public class FilterCheck
+    {
+        public const int MaxMedian = 5; // FILTER_MAX_MEDIAN
+        public const int AlphaOne = 256; // FILTER_ALPHA_ONE
+
+        public static readonly int[] Medians = { 1, 3, 5 };
+        public static readonly int[] Alphas = { 1, 3, 16, 64, 200, 256 };
+
+        // Model of filter.c (filter_config, seeded, pos, history and average of one quantity)
+        int median, alpha;
+        bool seeded;
+        int pos;
+        short[] history = new short[MaxMedian];
+        int average;
+
+        public FilterCheck(int median, int alpha)
+        {
+            this.median = median;
+            this.alpha = alpha;
+        }
+
+        static short Median(short[] v, int n)
+        {
+            short[] sorted = new short[MaxMedian];
+            for (int i = 0; i < n; i++)
+            {
+                short x = v[i];
+                int j;
+                for (j = i; j > 0 && sorted[j - 1] > x; j--)
+                    sorted[j] = sorted[j - 1];
+                sorted[j] = x;
+            }
+            return sorted[n / 2];
+        }
+
+        /// <summary>FILTER_Apply() for one quantity.</summary>
+        public short Apply(short x)
+        {
+            short result;
+            if (!seeded)
+            {
+                for (int i = 0; i < MaxMedian; i++)
+                    history[i] = x;
+                average = x << 8;
+                result = x;
+                seeded = true;
+                pos = 0;
+            }
+            else
+            {
+                history[pos] = x;
+                x = Median(history, median);
+                average += ((((x << 8) - average) * alpha) + 128) >> 8;
+                result = (short)((average + 128) >> 8);
+            }
+            if (++pos >= median)
+                pos = 0;
+            return result;
+        }
+
+        /// <summary>Floating point reference of the whole signal.</summary>
+        public static double[] Reference(short[] signal, int median, int alpha)
+        {
+            double[] output = new double[signal.Length];
+            double y = signal[0];
+            for (int n = 0; n < signal.Length; n++)
+            {
+                List<short> window = new List<short>();
+                for (int k = n - median + 1; k <= n; k++)
+                    window.Add(signal[Math.Max(k, 0)]);
+                window.Sort();
+                double x = window[median / 2];
+                y += (double)alpha / AlphaOne * (x - y);
+                output[n] = n == 0 ? signal[0] : y;
+            }
+            return output;
+        }
+
+        /// <summary>Test signals in raw units: name and samples.</summary>
+        public static Dictionary<string, short[]> Signals()
+        {
+            Dictionary<string, short[]> signals = new Dictionary<string, short[]>();
+            Random random = new Random(1);
+            const int length = 3000;
+
+            short[] step = new short[length];
+            for (int n = 0; n < length; n++)
+                step[n] = (short)(n < length / 3 ? -400 : n < 2 * length / 3 ? 800 : 0);
+            signals["step -40..80 C"] = step;
+
+            short[] humidity = new short[length];
+            for (int n = 0; n < length; n++)
+                humidity[n] = (short)(n < length / 2 ? 0 : 1000);
+            signals["step 0..100 %"] = humidity;
+
+            short[] ramp = new short[length];
+            for (int n = 0; n < length; n++)
+                ramp[n] = (short)(-400 + n * 1200 / length);
+            signals["ramp"] = ramp;
+
+            short[] noise = new short[length];
+            for (int n = 0; n < length; n++)
+            {
+                noise[n] = (short)(215 + random.Next(-3, 4));
+                if (random.Next(50) == 0)
+                    noise[n] += (short)(random.Next(2) == 0 ? -300 : 300); // Spike
+            }
+            signals["noise and spikes"] = noise;
+
+            short[] walk = new short[length];
+            int v = 0;
+            for (int n = 0; n < length; n++)
+            {
+                v = Math.Max(-400, Math.Min(800, v + random.Next(-2, 3)));
+                walk[n] = (short)v;
+            }
+            signals["random walk"] = walk;
+            return signals;
+        }
+
+        public static void Report(string[] args)
+        {
+            double limit = 1;
+            for (int n = 1; n < args.Length; n++)
+            {
+                if (args[n] == "/limit" && n + 1 < args.Length)
+                    limit = double.Parse(args[++n], CultureInfo.InvariantCulture);
+            }
+
+            Dictionary<string, short[]> signals = Signals();
+            int failed = 0;
+            using (StreamWriter w = new StreamWriter("filter.txt"))
+            {
+                foreach (int median in Medians)
+                {
+                    foreach (int alpha in Alphas)
+                    {
+                        double worst = 0;
+                        string where = "";
+                        foreach (KeyValuePair<string, short[]> signal in signals)
+                        {
+                            FilterCheck model = new FilterCheck(median, alpha);
+                            double[] reference = Reference(signal.Value, median, alpha);
+                            for (int n = 0; n < signal.Value.Length; n++)
+                            {
+                                double error = Math.Abs(model.Apply(signal.Value[n]) - reference[n]);
+                                if (error > worst)
+                                {
+                                    worst = error;
+                                    where = String.Format("{0}, sample {1}", signal.Key, n);
+                                }
+                            }
+                        }
+                        bool ok = worst <= limit;
+                        if (!ok)
+                            failed++;
+                        w.WriteLine(String.Format(CultureInfo.InvariantCulture, "median {0}, alpha {1}: max error {2:F3} ({3}){4}",
+                            median, alpha, worst, where, ok ? "" : " FAIL"));
+                    }
+                }
+                w.WriteLine("{0} of {1} configurations above {2}", failed, Medians.Length * Alphas.Length, limit);
+            }
+        }
+    }
+}
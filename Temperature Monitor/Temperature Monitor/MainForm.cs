@@ -16,8 +16,46 @@ namespace Temperature_Monitor
         int tickStart = 0;
         bool connected = false;
         int logStart = 0;
+        int errorCount = 0;
+        int badLines = 0;
+        int badFrames = 0; // Frames with a valid CRC that could not be decoded (other firmware version)
+        long lastAwake, lastAsleep; // Device time awake and asleep at the last health record (ms)
+        double awakePercent;
         SerialPort port;
         SerialDataReceivedEventHandler handler;
+        Protocol protocol;
+        Protocol.DeltaDecoder deltaDecoder;
+        TimeSync timeSync;
+        System.Threading.Timer syncTimer;
+        List<Protocol.LogSample> backlog = new List<Protocol.LogSample>();
+        List<Protocol.TraceEntry> trace = new List<Protocol.TraceEntry>();
+        bool profiling; // Cleared when the firmware is built without PROF_ENABLE
+
+        // Baud rate negotiation: the device starts at DefaultBaud, the faster rates are tried in order
+        const int DefaultBaud = 9600;
+        const int BaudConfirmTimeout = 1500; // ms, longer than the device's BAUD_CONFIRM_MS
+        static readonly int[] BaudRates = { 1000000, 500000, 250000, 57600 };
+        int baudIndex;
+        bool baudPending;
+        System.Threading.Timer baudTimer;
+        object baudLock = new object();
+
+        // Report by exception: the device only sends changes beyond these deadbands (0.1 units)
+        // or a sample every Heartbeat seconds; the graphs hold the last value (step-hold)
+        const int DeadbandTemperature = 2;
+        const int DeadbandHumidity = 5;
+        const int Heartbeat = 30;
+
+        // Sample filter of the device: median of 3 (spike rejection), then EWMA with alpha 0.5
+        const byte FilterMedian = 3;
+        const int FilterAlpha = 128;
+
+        // Binary samples in batches of up to 8, at most 1 s old
+        const byte BatchSamples = 8;
+        const int BatchLatency = 1000;
+
+        // Synchronization of the device clock, the samples are placed at their device time
+        const int SyncPeriod = 60000; // ms
 
         public MainForm()
         {
@@ -75,10 +113,120 @@ namespace Temperature_Monitor
         private void OpenPort(string portName)
         {
             port = new SerialPort();
-            port = new SerialPort(portName, 9600, Parity.None, 8, StopBits.One);
+            port = new SerialPort(portName, DefaultBaud, Parity.None, 8, StopBits.One);
             port.Open();
+            protocol = new Protocol();
+            deltaDecoder = new Protocol.DeltaDecoder();
+            timeSync = new TimeSync();
+            syncTimer = new System.Threading.Timer(SyncTimeout);
+            protocol.LineReceived += LineReceived;
+            protocol.FrameReceived += FrameReceived;
+            protocol.SendRequested += Send;
             handler = new SerialDataReceivedEventHandler(SerialDataReceived);
             port.DataReceived += handler;
+
+            baudIndex = 0;
+            baudTimer = new System.Threading.Timer(BaudTimeout);
+            NegotiateBaud();
+        }
+
+        private void Send(byte[] command)
+        {
+            port.Write(command, 0, command.Length);
+        }
+
+        /// <summary>
+        /// Asks the device for the next rate of BaudRates. When no rate is left,
+        /// stays at the current one and backfills the samples.
+        /// </summary>
+        private void NegotiateBaud()
+        {
+            lock (baudLock)
+            {
+                if (baudIndex >= BaudRates.Length)
+                {
+                    baudTimer.Change(System.Threading.Timeout.Infinite, System.Threading.Timeout.Infinite);
+                    Backfill();
+                    return;
+                }
+                baudPending = false;
+                baudTimer.Change(BaudConfirmTimeout, System.Threading.Timeout.Infinite);
+                Send(Protocol.SetBaud(BaudRates[baudIndex]));
+            }
+        }
+
+        private void BaudReply(byte cmd, byte status)
+        {
+            lock (baudLock)
+            {
+                if (cmd == Protocol.CmdSetBaud && status == Protocol.CmdOk)
+                {
+                    // The device switched after the reply, follow it and confirm with any command
+                    port.BaudRate = BaudRates[baudIndex];
+                    baudPending = true;
+                    baudTimer.Change(BaudConfirmTimeout, System.Threading.Timeout.Infinite);
+                    Send(Protocol.DumpStats(0));
+                    return;
+                }
+                if (cmd == Protocol.CmdSetBaud)
+                {
+                    baudIndex++; // Not supported by the device
+                }
+                else if (cmd == Protocol.CmdDumpStats && baudPending)
+                {
+                    baudPending = false;
+                    baudIndex = BaudRates.Length; // Confirmed
+                }
+                else
+                {
+                    return;
+                }
+            }
+            NegotiateBaud();
+        }
+
+        private void BaudTimeout(object state)
+        {
+            lock (baudLock)
+            {
+                // The device went back to DefaultBaud (or never left it)
+                try
+                {
+                    port.BaudRate = DefaultBaud;
+                }
+                catch (Exception)
+                {
+                    return; // Port closed
+                }
+                baudIndex++;
+            }
+            NegotiateBaud();
+        }
+
+        private void Backfill()
+        {
+            // Backfill the samples stored by the device while disconnected
+            Send(Protocol.DumpLog());
+            Send(Protocol.SetFilter(FilterMedian, FilterAlpha));
+            Send(Protocol.SetBatch(BatchSamples, BatchLatency));
+            Send(Protocol.SetFormat(Protocol.FormatBinary));
+            Send(Protocol.SetDeadband(DeadbandTemperature, DeadbandHumidity, Heartbeat));
+            profiling = true;
+            syncTimer.Change(0, SyncPeriod);
+        }
+
+        private void SyncTimeout(object state)
+        {
+            try
+            {
+                Send(timeSync.Start());
+                if (profiling)
+                    Send(Protocol.DumpProf());
+            }
+            catch (Exception)
+            {
+                // Port closed
+            }
         }
 
         private void Disconnect()
@@ -98,6 +246,16 @@ namespace Temperature_Monitor
                 try
                 {
                     port.DataReceived -= handler;
+                    if (baudTimer != null)
+                    {
+                        baudTimer.Dispose();
+                        baudTimer = null;
+                    }
+                    if (syncTimer != null)
+                    {
+                        syncTimer.Dispose();
+                        syncTimer = null;
+                    }
                     handler = null;
                     port.Close();
                 }
@@ -113,54 +271,363 @@ namespace Temperature_Monitor
             SerialPort senderPort = (SerialPort)sender;
             try
             {
-                if (senderPort.BytesToRead > 2)
-                {
-                    string rawData = senderPort.ReadTo("\n");
-                    if (rawData.Length > 1)
+                byte[] buffer = new byte[senderPort.BytesToRead];
+                int count = senderPort.Read(buffer, 0, buffer.Length);
+                protocol.Feed(buffer, count);
+            }
+            catch (ArgumentException)
+            {
+                // Payload shorter than its type (BitConverter)
+                badFrames++;
+            }
+            catch (IndexOutOfRangeException)
+            {
+                badFrames++;
+            }
+            catch (InvalidOperationException)
+            {
+                // Port closed or window disposed meanwhile
+            }
+            catch (IOException)
+            {
+                // Port gone (unplugged)
+            }
+        }
+
+        private void LineReceived(string rawData)
+        {
+            // The ASCII lines have no CRC: a corrupted one is counted and dropped
+            try
+            {
+                ParseLine(rawData.Split(','));
+            }
+            catch (FormatException)
+            {
+                badLines++;
+            }
+            catch (IndexOutOfRangeException)
+            {
+                badLines++;
+            }
+        }
+
+        private void ParseLine(string[] data)
+        {
+            switch (data[0])
+            {
+                case "OK":
+                    ShowSample(float.Parse(data[1]), float.Parse(data[2]));
+                    break;
+                case "ERROR":
+                    ShowError(data[1]);
+                    break;
+                case "AGG":
+                    ShowAggregate(Protocol.Aggregate.FromLine(data));
+                    break;
+                case "HEALTH":
+                    // HEALTH,sensor,ok,bus hung,not present,ack too long,sync timeout,data timeout,checksum,retries,lost,power cycles,
+                    //        awake,asleep,static RAM,stack peak,free RAM min
+                    ShowHealth(data[1], data[2], data[9], data[10], long.Parse(data[12]), long.Parse(data[13]),
+                        int.Parse(data[15]), int.Parse(data[16]));
+                    break;
+                default:
+                    break;
+            }
+        }
+
+        private void FrameReceived(byte type, byte[] payload)
+        {
+            switch (type)
+            {
+                case Protocol.FrameSample:
+                    // sensor, int16 temperature, uint16 humidity (tenths), uint32 device time (ms)
+                    ShowSample(BitConverter.ToInt16(payload, 1) / 10.0f, BitConverter.ToUInt16(payload, 3) / 10.0f,
+                        BitConverter.ToUInt32(payload, 5));
+                    break;
+                case Protocol.FrameError:
+                    ShowError(payload[1].ToString());
+                    break;
+                case Protocol.FrameHealth:
+                    // sensor, ok, err[7], retries, lost, power cycles (uint16), awake, asleep (uint32 ms),
+                    // static RAM, stack peak, free RAM min (uint16)
+                    ShowHealth(payload[0].ToString(), BitConverter.ToUInt16(payload, 1).ToString(),
+                        BitConverter.ToUInt16(payload, 17).ToString(), BitConverter.ToUInt16(payload, 19).ToString(),
+                        BitConverter.ToUInt32(payload, 23), BitConverter.ToUInt32(payload, 27),
+                        BitConverter.ToUInt16(payload, 33), BitConverter.ToUInt16(payload, 35));
+                    break;
+                case Protocol.FrameReply | Protocol.CmdReadLast:
+                case Protocol.FrameReply | Protocol.CmdReadLastN:
+                case Protocol.FrameReply | Protocol.CmdReadSince:
+                    // Poll mode: the records come in the replies
+                    foreach (Protocol.Record r in Protocol.ParseRecords(payload))
+                    {
+                        if (r.Status == 0)
+                            ShowSample(r.Temperature, r.Humidity);
+                        else
+                            ShowError(r.Status.ToString());
+                    }
+                    break;
+                case Protocol.FrameKey:
+                case Protocol.FrameDelta4:
+                case Protocol.FrameDelta8:
+                    int sensor;
+                    float t, h;
+                    if (deltaDecoder.Decode(type, payload, out sensor, out t, out h))
+                        ShowSample(t, h);
+                    break;
+                case Protocol.FrameBatch:
+                    ShowBatch(Protocol.ParseBatch(payload));
+                    break;
+                case Protocol.FrameAggregate:
+                    ShowAggregate(Protocol.Aggregate.FromFrame(payload));
+                    break;
+                case Protocol.FrameLog:
+                    backlog.AddRange(Protocol.ParseLog(payload));
+                    break;
+                case Protocol.FrameReply | Protocol.CmdDumpLog:
+                    // backlog.csv mirrors the device's log: time,boot,block,index,sensor,status,temperature,humidity
+                    // (oldest first). The time of the samples stored before the last reset of the device is unknown.
+                    Protocol.LogDump dump = Protocol.ParseLogDump(payload);
+                    DateTime received = DateTime.Now;
+                    StringBuilder csv = new StringBuilder();
+                    foreach (Protocol.LogSample r in backlog)
                     {
-                        string[] data = rawData.Split(',');
-                        switch (data[0])
+                        string time = dump != null && r.Boot == dump.Boot ?
+                            dump.TimeOf(r, received).ToString("yyyy-MM-dd HH:mm:ss") : "";
+                        csv.Append(String.Format("{0},{1},{2},{3},{4},{5},{6},{7}\r\n",
+                            time, r.Boot, r.Block, r.Index, r.Sensor, r.Status, r.Temperature, r.Humidity));
+                    }
+                    File.WriteAllText(String.Format(@"{0}\backlog.csv", Application.StartupPath), csv.ToString());
+                    backlog.Clear();
+                    break;
+                case Protocol.FrameReply | Protocol.CmdTimeSync:
+                    byte[] next = timeSync.Reply(payload, TimeSync.HostMs);
+                    if (next != null)
+                        Send(next);
+                    break;
+                case Protocol.FrameTrace:
+                    trace.AddRange(Protocol.ParseTrace(payload));
+                    break;
+                case Protocol.FrameReply | Protocol.CmdDumpProf:
+                    if (payload.Length > 0 && payload[0] == Protocol.CmdErrUnknown)
+                        profiling = false;
+                    else
+                        LogProfile(Protocol.ParseProf(payload), payload.Length > 1 ? payload[1] : 1);
+                    trace.Clear();
+                    break;
+                case Protocol.FrameReply | Protocol.CmdSetBaud:
+                case Protocol.FrameReply | Protocol.CmdDumpStats:
+                    if (payload.Length > 0)
+                        BaudReply((byte)(type & 0x7F), payload[0]);
+                    break;
+                default:
+                    if ((type & Protocol.FrameReply) != 0 && payload.Length > 0 && payload[0] != Protocol.CmdOk)
+                    {
+                        string reply = String.Format("Temperature and Humidity - command {0} failed ({1})", type & 0x7F, payload[0]);
+                        panel.Invoke((MethodInvoker)delegate
                         {
-                            case "OK":
-                                float temp = float.Parse(data[1]);
-                                float hum = float.Parse(data[2]);
-                                panel.Invoke((MethodInvoker)delegate
-                                {
-                                    lblTempReading.Text = temp.ToString() + "°C";
-                                    lblHumReading.Text = hum.ToString() + "%";
-                                    AddData(tempGraph, temp);
-                                    AddData(humGraph, hum);
-                                });
-
-                                int currentTickCount = Environment.TickCount;
-                                if ((currentTickCount - logStart) > 60000.0)
-                                {
-                                    string fileName = String.Format(@"{0}\log.csv", Application.StartupPath);
-                                    using (StreamWriter w = File.AppendText(fileName))
-                                    {
-                                        DateTime now = DateTime.Now;
-                                        w.Write(String.Format("{0:g}", now) + "," + temp + "," + hum + "\r\n");
-                                        w.Close();
-                                    }
-                                    logStart = currentTickCount;
-                                }
-
-                                break;
-                            case "ERROR":
-                                MessageBox.Show("DHT22 Error " + data[1]);
-                                Disconnect();
-                                break;
-                            default:
-                                break;
-                        }
+                            this.Text = reply;
+                        });
                     }
+                    break;
+            }
+        }
+
+        private void ShowSample(float temp, float hum)
+        {
+            panel.Invoke((MethodInvoker)delegate
+            {
+                lblTempReading.Text = temp.ToString() + "°C";
+                lblHumReading.Text = hum.ToString() + "%";
+                AddData(tempGraph, temp);
+                AddData(humGraph, hum);
+            });
+
+            LogSample(temp, hum, DateTime.Now, double.NaN);
+        }
+
+        /// <summary>
+        /// Shows a sample with its device time (ms).
+        /// </summary>
+        private void ShowSample(float temp, float hum, uint deviceTime)
+        {
+            DateTime time;
+            double bound;
+            int tickCount = SampleTime(deviceTime, deviceTime, out time, out bound);
+
+            panel.Invoke((MethodInvoker)delegate
+            {
+                lblTempReading.Text = temp.ToString() + "°C";
+                lblHumReading.Text = hum.ToString() + "%";
+                AddData(tempGraph, temp, tickCount);
+                AddData(humGraph, hum, tickCount);
+            });
+
+            LogSample(temp, hum, time, bound);
+        }
+
+        /// <summary>
+        /// Converts a device time to a tick count (graphs) and a wall clock time with its error
+        /// bound (ms). Before the first synchronization, the sample at newest device time is
+        /// taken as received now and the bound is unknown (NaN).
+        /// </summary>
+        private int SampleTime(uint deviceTime, uint newest, out DateTime time, out double bound)
+        {
+            long now = TimeSync.HostMs;
+            double hostMs;
+            if (!timeSync.ToHost(deviceTime, out hostMs, out bound))
+            {
+                hostMs = now - (int)(newest - deviceTime);
+                bound = double.NaN;
+            }
+            time = TimeSync.WallClock(hostMs);
+            return Environment.TickCount - (int)(now - hostMs);
+        }
+
+        /// <summary>
+        /// Shows the entries of a batch with one call to the UI thread. The samples are
+        /// placed in time from their device times.
+        /// </summary>
+        private void ShowBatch(List<Protocol.BatchEntry> entries)
+        {
+            if (entries.Count == 0)
+                return;
+            uint newest = entries[entries.Count - 1].Time;
+            Protocol.BatchEntry last = null;
+            int[] tickCounts = new int[entries.Count];
+            DateTime time = DateTime.Now;
+            double bound = double.NaN;
+
+            for (int i = 0; i < entries.Count; i++)
+            {
+                Protocol.BatchEntry e = entries[i];
+                if (e.Status != 0)
+                {
+                    ShowError(e.Status.ToString());
+                    continue;
                 }
+                last = e;
+                tickCounts[i] = SampleTime(e.Time, newest, out time, out bound);
             }
-            catch (Exception ex)
+            if (last == null)
+                return;
+
+            panel.Invoke((MethodInvoker)delegate
             {
+                lblTempReading.Text = last.Temperature.ToString() + "°C";
+                lblHumReading.Text = last.Humidity.ToString() + "%";
+                for (int i = 0; i < entries.Count; i++)
+                {
+                    if (entries[i].Status != 0)
+                        continue;
+                    AddData(tempGraph, entries[i].Temperature, tickCounts[i]);
+                    AddData(humGraph, entries[i].Humidity, tickCounts[i]);
+                }
+            });
 
+            LogSample(last.Temperature, last.Humidity, time, bound);
+        }
+
+        /// <summary>
+        /// Appends a sample to log.csv once a minute: time,temperature,humidity,time error bound (ms,
+        /// empty before the clock synchronization).
+        /// </summary>
+        private void LogSample(float temp, float hum, DateTime time, double bound)
+        {
+            int currentTickCount = Environment.TickCount;
+            if ((currentTickCount - logStart) > 60000.0)
+            {
+                string fileName = String.Format(@"{0}\log.csv", Application.StartupPath);
+                using (StreamWriter w = File.AppendText(fileName))
+                {
+                    w.Write(String.Format("{0:yyyy-MM-dd HH:mm:ss.fff},{1},{2},{3}\r\n", time, temp, hum,
+                        double.IsNaN(bound) ? "" : bound.ToString("F0")));
+                    w.Close();
+                }
+                logStart = currentTickCount;
+            }
+        }
+
+        /// <summary>
+        /// Appends the profiling statistics to profile.csv, one line per section:
+        /// time,section,count,min,average,max (CPU cycles since the device start-up), and
+        /// writes the last sections run to trace.csv: section,start (Timer1),cycles.
+        /// </summary>
+        private void LogProfile(List<Protocol.ProfStats> stats, int cyclesPerCount)
+        {
+            string fileName = String.Format(@"{0}\profile.csv", Application.StartupPath);
+            using (StreamWriter w = File.AppendText(fileName))
+            {
+                foreach (Protocol.ProfStats p in stats)
+                {
+                    w.Write(String.Format("{0:g},{1},{2},{3},{4:F1},{5}\r\n", DateTime.Now, p.Name, p.Count,
+                        p.Min, p.Average, p.Max));
+                }
             }
 
+            StringBuilder lines = new StringBuilder();
+            foreach (Protocol.TraceEntry e in trace)
+            {
+                string name = e.Id < Protocol.ProfStats.Names.Length ? Protocol.ProfStats.Names[e.Id] : e.Id.ToString();
+                lines.Append(String.Format("{0},{1},{2}\r\n", name, e.Start, e.Counts * cyclesPerCount));
+            }
+            File.WriteAllText(String.Format(@"{0}\trace.csv", Application.StartupPath), lines.ToString());
+        }
+
+        private void ShowAggregate(Protocol.Aggregate a)
+        {
+            if (a.Count > 0)
+            {
+                panel.Invoke((MethodInvoker)delegate
+                {
+                    lblTempReading.Text = a.TemperatureMean.ToString() + "°C";
+                    lblHumReading.Text = a.HumidityMean.ToString() + "%";
+                    AddData(tempGraph, a.TemperatureMean);
+                    AddData(humGraph, a.HumidityMean);
+                });
+            }
+
+            // One line per interval: time,sensor,count,errors,tmin,tmax,tmean,hmin,hmax,hmean
+            string fileName = String.Format(@"{0}\aggregate.csv", Application.StartupPath);
+            using (StreamWriter w = File.AppendText(fileName))
+            {
+                w.Write(String.Format("{0:g},{1},{2},{3},{4},{5},{6},{7},{8},{9}\r\n", DateTime.Now, a.Sensor, a.Count, a.Errors,
+                    a.TemperatureMin, a.TemperatureMax, a.TemperatureMean, a.HumidityMin, a.HumidityMax, a.HumidityMean));
+            }
+        }
+
+        private void ShowError(string error)
+        {
+            // The device already retried the reading, only this sample is lost.
+            errorCount++;
+            panel.Invoke((MethodInvoker)delegate
+            {
+                this.Text = String.Format("Temperature and Humidity - {0} errors (last: DHT22 Error {1})", errorCount, error);
+            });
+        }
+
+        /// <summary>
+        /// Shows the health record of a sensor, with the share of time the device was awake
+        /// since the previous record (the awake and asleep times are totals since start-up), and
+        /// the deepest stack and the RAM never used since start-up (see MapReport for the static RAM).
+        /// </summary>
+        private void ShowHealth(string sensor, string ok, string retries, string lost, long awake, long asleep,
+            int stackPeak, int freeRam)
+        {
+            long total = (awake - lastAwake) + (asleep - lastAsleep);
+            if (total > 0)
+                awakePercent = 100.0 * (awake - lastAwake) / total;
+            lastAwake = awake;
+            lastAsleep = asleep;
+
+            string health = String.Format("Temperature and Humidity - sensor {0}: {1} ok, {2} retries, {3} lost" +
+                " - link: {4} corrupted, {5} recovered, {6} lost, {7} bad lines, {8} bad frames - awake {9:F1}% - stack {10} B, {11} B free",
+                sensor, ok, retries, lost, protocol.Corrupted, protocol.Recovered, protocol.Lost, badLines, badFrames,
+                awakePercent, stackPeak, freeRam);
+            panel.Invoke((MethodInvoker)delegate
+            {
+                this.Text = health;
+            });
         }
 
         private void DropDown(object sender, EventArgs e)
@@ -185,6 +652,9 @@ namespace Temperature_Monitor
             // Color is blue, and there will be no symbols
             LineItem curve = myPane.AddCurve(label, list, Color.Blue, SymbolType.None);
 
+            // The device reports by exception, a value holds until the next one
+            curve.Line.StepType = StepType.ForwardStep;
+
             // Just manually control the X axis range so it scrolls continuously
             // instead of discrete step-sized jumps
             myPane.XAxis.Scale.Min = 0;
@@ -200,6 +670,11 @@ namespace Temperature_Monitor
         }
 
         private void AddData(ZedGraphControl graph, float yValue)
+        {
+            AddData(graph, yValue, Environment.TickCount);
+        }
+
+        private void AddData(ZedGraphControl graph, float yValue, int tickCount)
         {
             // Make sure that the curvelist has at least one curve
             if (graph.GraphPane.CurveList.Count <= 0)
@@ -218,7 +693,7 @@ namespace Temperature_Monitor
                 return;
 
             // Time is measured in seconds
-            double time = (Environment.TickCount - tickStart) / 1000.0;
+            double time = (tickCount - tickStart) / 1000.0;
 
             list.Add(time, yValue);
 
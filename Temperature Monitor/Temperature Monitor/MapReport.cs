@@ -0,0 +1,117 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+using System.Text.RegularExpressions;
+
+namespace Temperature_Monitor
+{
+    /// <summary>
+    /// Memory report of the firmware from its linker map (Debug/Testing.map): flash and static
+    /// RAM of each object file, so the buffers can be sized against the free RAM the device
+    /// reports in its health records (mem.h in the firmware).
+    /// Run "Temperature Monitor.exe /map Testing.map": the report is written to Testing.map.txt.
+    /// </summary>
+    public class MapReport
+    {
+        public const int Flash = 32768; // ATmega328P
+        public const int Ram = 2048;
+
+        /// <summary>Sizes of an object file (bytes). Data is both in flash and in RAM.</summary>
+        public class Module
+        {
+            public string Name;
+            public int Text;
+            public int Data;
+            public int Bss;
+
+            public int FlashBytes { get { return Text + Data; } }
+            public int RamBytes { get { return Data + Bss; } }
+        }
+
+        public List<Module> Modules = new List<Module>();
+
+        // Input section: " .bss 0x00800100 0x40 src/cache.o", the name can be alone on the previous line
+        static readonly Regex InputSection = new Regex(@"^ (\S+)?\s+0x([0-9a-fA-F]+)\s+0x([0-9a-fA-F]+)\s+(.+)$");
+        // Output section: ".bss 0x00800100 0x40"
+        static readonly Regex OutputSection = new Regex(@"^(\.\S+)\s+0x[0-9a-fA-F]+\s+0x[0-9a-fA-F]+");
+
+        /// <summary>
+        /// Reads the input sections of the .text, .data, .bss and .noinit output sections.
+        /// </summary>
+        public static MapReport Parse(string path)
+        {
+            MapReport report = new MapReport();
+            Dictionary<string, Module> modules = new Dictionary<string, Module>();
+            string output = null;
+            string pending = null; // Input section name alone on its line
+
+            foreach (string line in File.ReadAllLines(path))
+            {
+                Match m = OutputSection.Match(line);
+                if (m.Success)
+                {
+                    output = m.Groups[1].Value;
+                    pending = null;
+                    continue;
+                }
+                if (line.StartsWith(" .") && line.Trim().IndexOf(' ') < 0)
+                {
+                    pending = line.Trim();
+                    continue;
+                }
+                m = InputSection.Match(line);
+                if (!m.Success || output == null)
+                    continue;
+                string section = m.Groups[1].Success ? m.Groups[1].Value : pending;
+                pending = null;
+                if (section == null)
+                    continue;
+                int size = int.Parse(m.Groups[3].Value, NumberStyles.HexNumber);
+                if (size == 0)
+                    continue;
+
+                string name = m.Groups[4].Value.Trim();
+                name = name.Substring(name.LastIndexOfAny(new char[] { '/', '\\' }) + 1);
+                Module module;
+                if (!modules.TryGetValue(name, out module))
+                {
+                    module = new Module();
+                    module.Name = name;
+                    modules.Add(name, module);
+                    report.Modules.Add(module);
+                }
+                if (output == ".text")
+                    module.Text += size;
+                else if (output == ".data")
+                    module.Data += size;
+                else if (output == ".bss" || output == ".noinit")
+                    module.Bss += size;
+            }
+            report.Modules.Sort(delegate(Module a, Module b) { return b.RamBytes.CompareTo(a.RamBytes); });
+            return report;
+        }
+
+        /// <summary>
+        /// Writes the table of the modules, largest RAM first, and the totals.
+        /// </summary>
+        public void Write(TextWriter w)
+        {
+            int text = 0, data = 0, bss = 0;
+            w.WriteLine("{0,-28} {1,8} {2,8} {3,8}", "Module", "Flash", "Data", "Bss");
+            foreach (Module m in Modules)
+            {
+                if (m.FlashBytes == 0 && m.RamBytes == 0)
+                    continue;
+                w.WriteLine("{0,-28} {1,8} {2,8} {3,8}", m.Name, m.FlashBytes, m.Data, m.Bss);
+                text += m.Text;
+                data += m.Data;
+                bss += m.Bss;
+            }
+            w.WriteLine();
+            w.WriteLine("Flash: {0} of {1} bytes ({2:F1}%)", text + data, Flash, 100.0 * (text + data) / Flash);
+            w.WriteLine("Static RAM: {0} of {1} bytes ({2:F1}%), {3} left for the stack",
+                data + bss, Ram, 100.0 * (data + bss) / Ram, Ram - data - bss);
+        }
+    }
+}
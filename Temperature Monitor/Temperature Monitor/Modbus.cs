@@ -0,0 +1,354 @@
+﻿using System;
+using System.Collections.Generic;
+using System.IO;
+using System.IO.Ports;
+using System.Threading;
+
+namespace Temperature_Monitor
+{
+    /// <summary>
+    /// Exception reply of a Modbus slave.
+    /// </summary>
+    public class ModbusException : Exception
+    {
+        public byte Code;
+
+        public ModbusException(byte code)
+            : base(String.Format("Modbus exception {0}", code))
+        {
+            Code = code;
+        }
+    }
+
+    /// <summary>
+    /// Modbus RTU master over a serial port (RS-485 adapter).
+    /// Timeouts raise TimeoutException, bad replies raise IOException.
+    /// The line is left idle for GapMs before each request: the nodes end a frame when a
+    /// whole tick passes without bytes (modbus.h), so the gap is 3.5 characters plus 2 ticks.
+    /// </summary>
+    public class ModbusMaster
+    {
+        public const byte ReadHolding = 0x03;
+        public const byte ReadInput = 0x04;
+        public const byte WriteSingle = 0x06;
+
+        public const byte ExAddress = 0x02;
+
+        public const int SlaveTickMs = 10; // ACQ_TICK_MS
+
+        /// <summary>Silence before a request (ms).</summary>
+        public int GapMs;
+
+        Stream stream;
+        SerialPort port; // null on a stand-in bus (ModbusBus)
+        int lastTraffic;
+
+        public ModbusMaster(SerialPort port)
+            : this(port.BaseStream, port.BaudRate)
+        {
+            this.port = port;
+        }
+
+        /// <summary>
+        /// Master on a stream. Its Read must raise TimeoutException when no reply comes.
+        /// </summary>
+        public ModbusMaster(Stream stream, int baudRate)
+        {
+            this.stream = stream;
+            GapMs = InterFrameGapMs(baudRate);
+            lastTraffic = Environment.TickCount - GapMs;
+        }
+
+        /// <summary>
+        /// 3.5 characters of 11 bits (8E1) and 2 ticks of the nodes, so one whole tick
+        /// without bytes is seen whatever the phase of their tick.
+        /// </summary>
+        public static int InterFrameGapMs(int baudRate)
+        {
+            return (int)Math.Ceiling(3.5 * 11 * 1000 / baudRate) + 2 * SlaveTickMs;
+        }
+
+        /// <summary>
+        /// Opens a port with the slave's serial format (8 data bits, even parity, 1 stop bit).
+        /// </summary>
+        public static SerialPort OpenPort(string portName, int baudRate)
+        {
+            SerialPort port = new SerialPort(portName, baudRate, Parity.Even, 8, StopBits.One);
+            port.ReadTimeout = 100;
+            port.Open();
+            return port;
+        }
+
+        public static ushort Crc(byte[] data, int count)
+        {
+            ushort crc = 0xFFFF;
+            for (int i = 0; i < count; i++)
+            {
+                crc ^= data[i];
+                for (int n = 0; n < 8; n++)
+                    crc = (ushort)((crc & 1) != 0 ? (crc >> 1) ^ 0xA001 : crc >> 1);
+            }
+            return crc;
+        }
+
+        public ushort[] ReadInputRegisters(byte slave, ushort start, ushort count)
+        {
+            return Read(slave, ReadInput, start, count);
+        }
+
+        public ushort[] ReadHoldingRegisters(byte slave, ushort start, ushort count)
+        {
+            return Read(slave, ReadHolding, start, count);
+        }
+
+        public void WriteSingleRegister(byte slave, ushort register, ushort value)
+        {
+            Transfer(slave, WriteSingle, register, value, 8);
+        }
+
+        ushort[] Read(byte slave, byte function, ushort start, ushort count)
+        {
+            byte[] reply = Transfer(slave, function, start, count, 5 + count * 2);
+            ushort[] values = new ushort[count];
+            for (int i = 0; i < count; i++)
+                values[i] = (ushort)((reply[3 + i * 2] << 8) | reply[4 + i * 2]);
+            return values;
+        }
+
+        byte[] Transfer(byte slave, byte function, ushort a, ushort b, int replyLength)
+        {
+            byte[] request = new byte[8];
+            request[0] = slave;
+            request[1] = function;
+            request[2] = (byte)(a >> 8);
+            request[3] = (byte)a;
+            request[4] = (byte)(b >> 8);
+            request[5] = (byte)b;
+            ushort crc = Crc(request, 6);
+            request[6] = (byte)crc;
+            request[7] = (byte)(crc >> 8);
+
+            int idle = Environment.TickCount - lastTraffic;
+            if (idle >= 0 && idle < GapMs)
+                Thread.Sleep(GapMs - idle);
+            if (port != null)
+                port.DiscardInBuffer();
+            try
+            {
+                stream.Write(request, 0, request.Length);
+
+                // Exception replies are 5 bytes long, read those first
+                byte[] reply = new byte[Math.Max(replyLength, 5)];
+                ReadBytes(reply, 0, 5);
+                if (reply[0] != slave)
+                    throw new System.IO.IOException("Modbus reply from another slave");
+                if (reply[1] == (function | 0x80))
+                {
+                    CheckCrc(reply, 5);
+                    throw new ModbusException(reply[2]);
+                }
+                ReadBytes(reply, 5, replyLength - 5);
+                if (reply[1] != function)
+                    throw new System.IO.IOException("Modbus reply to another function");
+                CheckCrc(reply, replyLength);
+                return reply;
+            }
+            finally
+            {
+                lastTraffic = Environment.TickCount;
+            }
+        }
+
+        void ReadBytes(byte[] buffer, int offset, int count)
+        {
+            while (count > 0)
+            {
+                int n = stream.Read(buffer, offset, count);
+                offset += n;
+                count -= n;
+            }
+        }
+
+        static void CheckCrc(byte[] reply, int length)
+        {
+            if (Crc(reply, length) != 0)
+                throw new System.IO.IOException("Modbus CRC error");
+        }
+    }
+
+    /// <summary>
+    /// Polls the DHT22 nodes of a bus (addresses 1 to MaxNodes), see modbus.h in the firmware.
+    /// Each node is read with one request (all its sensors). The number of sensors of a
+    /// node is found the first time it answers. A node that does not answer is probed
+    /// again only every OfflineProbeScans scans, so the absent addresses do not cost a
+    /// timeout each scan.
+    /// </summary>
+    public class ModbusPoller
+    {
+        public const int MaxNodes = 32;
+        public const int MaxSensors = 8;
+        public const int MaxRead = 125; // Registers per request (MB_MAX_READ)
+        public const int OfflineProbeScans = 10;
+
+        // Input registers of a sensor block
+        public const int IrTemperature = 0;
+        public const int IrHumidity = 1;
+        public const int IrStatus = 2;
+        public const int IrSeq = 3;
+        public const int IrOk = 4;
+        public const int IrErr = 5;
+        public const int IrRetries = 11;
+        public const int IrLost = 12;
+        public const int IrPowerCycles = 13;
+        public const int IrBlock = 16;
+
+        public const ushort NoData = 0xFFFF;
+
+        public delegate void SampleHandler(byte node, int sensor, ushort status, float temperature, float humidity);
+        public delegate void NodeHandler(byte node, bool online);
+
+        /// <summary>Raised for each new record of a sensor (status 0 is a sample, otherwise the DHT22 error).</summary>
+        public event SampleHandler SampleReceived;
+        public event NodeHandler NodeChanged;
+
+        public int ScanPeriodMs = 1000;
+
+        ModbusMaster master;
+        int[] sensors = new int[MaxNodes + 1]; // 0 = offline
+        int[] skip = new int[MaxNodes + 1];
+        ushort[,] lastSeq = new ushort[MaxNodes + 1, MaxSensors];
+        Thread thread;
+        volatile bool running = true; // Until Stop, so Scan can also be called without Start
+
+        public ModbusPoller(ModbusMaster master)
+        {
+            this.master = master;
+        }
+
+        public void Start()
+        {
+            running = true;
+            thread = new Thread(Run);
+            thread.IsBackground = true;
+            thread.Start();
+        }
+
+        public void Stop()
+        {
+            running = false;
+            if (thread != null)
+                thread.Join();
+        }
+
+        void Run()
+        {
+            while (running)
+            {
+                int start = Environment.TickCount;
+                Scan();
+                int elapsed = Environment.TickCount - start;
+                if (elapsed < ScanPeriodMs)
+                    Thread.Sleep(ScanPeriodMs - elapsed);
+            }
+        }
+
+        /// <summary>
+        /// Reads every online node once and probes the offline ones that are due.
+        /// </summary>
+        public void Scan()
+        {
+            for (byte node = 1; node <= MaxNodes && running; node++)
+            {
+                if (sensors[node] == 0)
+                {
+                    if (skip[node] > 0)
+                    {
+                        skip[node]--;
+                        continue;
+                    }
+                    skip[node] = OfflineProbeScans;
+                }
+                try
+                {
+                    if (sensors[node] == 0)
+                    {
+                        sensors[node] = CountSensors(node);
+                        for (int i = 0; i < MaxSensors; i++)
+                            lastSeq[node, i] = NoData;
+                        if (NodeChanged != null)
+                            NodeChanged(node, true);
+                    }
+                    ReadNode(node);
+                }
+                catch (TimeoutException)
+                {
+                    SetOffline(node);
+                }
+                catch (System.IO.IOException)
+                {
+                    SetOffline(node);
+                }
+                catch (ModbusException)
+                {
+                    SetOffline(node);
+                }
+            }
+        }
+
+        void SetOffline(byte node)
+        {
+            if (sensors[node] != 0 && NodeChanged != null)
+                NodeChanged(node, false);
+            sensors[node] = 0;
+        }
+
+        /// <summary>
+        /// Reads one register of each block until the node answers "illegal address".
+        /// </summary>
+        int CountSensors(byte node)
+        {
+            master.ReadInputRegisters(node, IrTemperature, 1);
+            int count = 1;
+            try
+            {
+                for (; count < MaxSensors; count++)
+                    master.ReadInputRegisters(node, (ushort)(count * IrBlock), 1);
+            }
+            catch (ModbusException ex)
+            {
+                if (ex.Code != ModbusMaster.ExAddress)
+                    throw;
+            }
+            return count;
+        }
+
+        /// <summary>
+        /// Reads the sensors of a node, as many blocks per request as MaxRead allows
+        /// (7, so two requests for a node of 8 sensors).
+        /// </summary>
+        void ReadNode(byte node)
+        {
+            int count = sensors[node];
+            int perRequest = MaxRead / IrBlock;
+            for (int first = 0; first < count; first += perRequest)
+            {
+                int n = Math.Min(perRequest, count - first);
+                ushort[] regs = master.ReadInputRegisters(node, (ushort)(first * IrBlock),
+                    (ushort)((n - 1) * IrBlock + IrPowerCycles + 1));
+                for (int i = 0; i < n; i++)
+                {
+                    int sensor = first + i;
+                    int block = i * IrBlock;
+                    ushort status = regs[block + IrStatus];
+                    ushort seq = regs[block + IrSeq];
+                    if (status == NoData || seq == lastSeq[node, sensor])
+                        continue;
+                    lastSeq[node, sensor] = seq;
+                    if (SampleReceived != null)
+                        SampleReceived(node, sensor, status,
+                            (short)regs[block + IrTemperature] / 10.0f, regs[block + IrHumidity] / 10.0f);
+                }
+            }
+        }
+    }
+}
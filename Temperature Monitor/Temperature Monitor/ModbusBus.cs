@@ -0,0 +1,346 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+using System.IO;
+
+namespace Temperature_Monitor
+{
+    /// <summary>
+    /// Stand-in for an RS-485 bus of DHT22 nodes in Modbus mode (modbus.c), so the framing of
+    /// ModbusMaster can be checked against the one of the nodes without hardware.
+    /// Run "Temperature Monitor.exe /modbus [/nodes n] [/sensors n] [/scans n] [/baud rate] [/nogap] [/noresync]":
+    /// a ModbusPoller scans the bus (addresses 1 to ModbusPoller.MaxNodes, the first nodes
+    /// present with 8 sensors by default), the samples it gets are written to modbus.txt.
+    /// /nogap sends the requests without the inter-frame gap, /noresync models the nodes
+    /// before the resynchronisation on the end of the burst (the whole burst is the request).
+    ///
+    /// The master writes and reads this stream. The time of the bus is virtual: it advances
+    /// by the real time the master spends between two calls (its gap) and by the time of each
+    /// byte on the line. Every byte is seen by all the nodes (half duplex bus). A node polls its
+    /// bytes every tick (ACQ_TICK_MS, each node with its own phase) and ends a burst when a
+    /// whole tick passes without bytes, like MB_Poll(). The registers read back their address,
+    /// except the status (0) and the sequence number (Seq, the scan).
+    /// </summary>
+    public class ModbusBus : Stream
+    {
+        public const int TickMs = ModbusMaster.SlaveTickMs;
+        public const int MaxRequest = 16; // MB_MAX_REQUEST
+        public const int BlockRegisters = ModbusPoller.IrBlock; // MB_IR_BLOCK
+        public const int MaxRead = 125; // MB_MAX_READ
+
+        internal struct Timed
+        {
+            public double Time; // ms, end of the byte on the line
+            public byte Value;
+
+            public Timed(double time, byte value)
+            {
+                Time = time;
+                Value = value;
+            }
+        }
+
+        /// <summary>Model of the framing of a node (MB_Poll).</summary>
+        public class Node
+        {
+            public byte Address;
+            public int Registers;
+            public bool Resync = true;
+            public int Executed; // Requests to this node executed
+            public ushort Seq; // Sequence number of the records
+
+            internal Queue<Timed> Pending = new Queue<Timed>();
+            double lastTick;
+            byte[] rx = new byte[MaxRequest];
+            int rxLen;
+            bool rxError;
+
+            public Node(byte address, int registers, double phase)
+            {
+                Address = address;
+                Registers = registers;
+                lastTick = phase - TickMs;
+            }
+
+            /// <summary>Time of the next poll that has something to do, or infinity.</summary>
+            internal double NextPoll()
+            {
+                double next = lastTick + TickMs;
+                if (rxLen > 0)
+                    return next;
+                if (Pending.Count == 0)
+                    return double.PositiveInfinity;
+                double first = Pending.Peek().Time;
+                if (first > next)
+                    next += Math.Ceiling((first - next) / TickMs) * TickMs;
+                return next;
+            }
+
+            /// <summary>Poll at time (NextPoll), returns the reply to send or null.</summary>
+            internal byte[] Poll(double time)
+            {
+                lastTick = time;
+                bool received = false;
+                while (Pending.Count > 0 && Pending.Peek().Time <= time)
+                {
+                    received = true;
+                    byte c = Pending.Dequeue().Value;
+                    if (Resync)
+                    {
+                        if (rxLen == MaxRequest)
+                        {
+                            Array.Copy(rx, 1, rx, 0, MaxRequest - 1);
+                            rxLen--;
+                        }
+                        rx[rxLen++] = c;
+                    }
+                    else if (rxLen < MaxRequest)
+                        rx[rxLen++] = c;
+                    else
+                        rxError = true;
+                }
+                if (received || rxLen == 0)
+                    return null;
+
+                byte[] reply = null;
+                bool found = false;
+                if (Resync)
+                {
+                    for (int start = 0; start < rxLen && !found; start++)
+                        found = Request(start, rxLen - start, out reply);
+                }
+                else if (!rxError)
+                    found = Request(0, rxLen, out reply);
+                if (found)
+                    Executed++;
+                rxLen = 0;
+                rxError = false;
+                return reply;
+            }
+
+            public ushort Register(int register)
+            {
+                switch (register % BlockRegisters)
+                {
+                    case ModbusPoller.IrStatus:
+                        return 0;
+                    case ModbusPoller.IrSeq:
+                        return Seq;
+                    default:
+                        return (ushort)register;
+                }
+            }
+
+            bool Request(int start, int len, out byte[] reply)
+            {
+                reply = null;
+                if (len < 4 || rx[start] != Address)
+                    return false;
+                byte[] p = new byte[len];
+                Array.Copy(rx, start, p, 0, len);
+                if (ModbusMaster.Crc(p, len) != 0)
+                    return false;
+                int first = (p[2] << 8) | p[3];
+                int count = (p[4] << 8) | p[5];
+                if (len != 8 || p[1] != ModbusMaster.ReadInput)
+                    reply = new byte[] { Address, (byte)(p[1] | 0x80), 1, 0, 0 };
+                else if (count == 0 || count > MaxRead)
+                    reply = new byte[] { Address, (byte)(p[1] | 0x80), 3, 0, 0 }; // MB_EX_VALUE
+                else if (first + count > Registers)
+                    reply = new byte[] { Address, (byte)(p[1] | 0x80), ModbusMaster.ExAddress, 0, 0 };
+                else
+                {
+                    reply = new byte[5 + count * 2];
+                    reply[0] = Address;
+                    reply[1] = p[1];
+                    reply[2] = (byte)(count * 2);
+                    for (int i = 0; i < count; i++)
+                    {
+                        ushort value = Register(first + i);
+                        reply[3 + i * 2] = (byte)(value >> 8);
+                        reply[4 + i * 2] = (byte)value;
+                    }
+                }
+                ushort crc = ModbusMaster.Crc(reply, reply.Length - 2);
+                reply[reply.Length - 2] = (byte)crc;
+                reply[reply.Length - 1] = (byte)(crc >> 8);
+                return true;
+            }
+        }
+
+        public List<Node> Nodes = new List<Node>();
+        public int TimeoutMs = 100; // SerialPort.ReadTimeout of ModbusMaster.OpenPort
+
+        double charMs;
+        double now;
+        Queue<Timed> received = new Queue<Timed>(); // Bytes to the master
+        Stopwatch clock = Stopwatch.StartNew();
+
+        public ModbusBus(int baudRate)
+        {
+            charMs = 11 * 1000.0 / baudRate;
+        }
+
+        /// <summary>Puts bytes on the line from time, they are seen by all but the sender.</summary>
+        void Send(byte[] data, double time, Node sender)
+        {
+            for (int i = 0; i < data.Length; i++)
+            {
+                Timed t = new Timed(time + (i + 1) * charMs, data[i]);
+                foreach (Node node in Nodes)
+                {
+                    if (node != sender)
+                        node.Pending.Enqueue(t);
+                }
+                if (sender != null)
+                    received.Enqueue(t);
+            }
+        }
+
+        /// <summary>Runs the first poll of a node before limit. Returns false if there is none.</summary>
+        bool Step(double limit)
+        {
+            Node next = null;
+            double time = limit;
+            foreach (Node node in Nodes)
+            {
+                double t = node.NextPoll();
+                if (t <= time)
+                {
+                    time = t;
+                    next = node;
+                }
+            }
+            if (next == null)
+                return false;
+            byte[] reply = next.Poll(time);
+            if (reply != null)
+                Send(reply, time, next);
+            return true;
+        }
+
+        public override void Write(byte[] buffer, int offset, int count)
+        {
+            now += clock.Elapsed.TotalMilliseconds;
+            while (Step(now))
+                ;
+            received.Clear();
+            byte[] data = new byte[count];
+            Array.Copy(buffer, offset, data, 0, count);
+            Send(data, now, null);
+            now += count * charMs;
+            clock.Restart();
+        }
+
+        public override int Read(byte[] buffer, int offset, int count)
+        {
+            now += clock.Elapsed.TotalMilliseconds;
+            double deadline = now + TimeoutMs;
+            while (received.Count == 0 || received.Peek().Time > deadline)
+            {
+                if (!Step(deadline))
+                {
+                    now = deadline;
+                    clock.Restart();
+                    throw new TimeoutException();
+                }
+            }
+            int n = 0;
+            while (n < count && received.Count > 0 && received.Peek().Time <= deadline)
+            {
+                Timed t = received.Dequeue();
+                buffer[offset + n++] = t.Value;
+                now = Math.Max(now, t.Time);
+            }
+            clock.Restart();
+            return n;
+        }
+
+        public override bool CanRead { get { return true; } }
+        public override bool CanSeek { get { return false; } }
+        public override bool CanWrite { get { return true; } }
+        public override long Length { get { throw new NotSupportedException(); } }
+        public override long Position
+        {
+            get { throw new NotSupportedException(); }
+            set { throw new NotSupportedException(); }
+        }
+        public override void Flush() { }
+        public override long Seek(long offset, SeekOrigin origin) { throw new NotSupportedException(); }
+        public override void SetLength(long value) { throw new NotSupportedException(); }
+
+        public static void Report(string[] args)
+        {
+            int nodes = 8, sensors = ModbusPoller.MaxSensors, scans = 10, baudRate = 9600;
+            bool gap = true, resync = true;
+            for (int n = 1; n < args.Length; n++)
+            {
+                if (args[n] == "/nodes" && n + 1 < args.Length)
+                    nodes = int.Parse(args[++n]);
+                else if (args[n] == "/sensors" && n + 1 < args.Length)
+                    sensors = int.Parse(args[++n]);
+                else if (args[n] == "/scans" && n + 1 < args.Length)
+                    scans = int.Parse(args[++n]);
+                else if (args[n] == "/baud" && n + 1 < args.Length)
+                    baudRate = int.Parse(args[++n]);
+                else if (args[n] == "/nogap")
+                    gap = false;
+                else if (args[n] == "/noresync")
+                    resync = false;
+            }
+
+            ModbusBus bus = new ModbusBus(baudRate);
+            Random random = new Random(1);
+            for (int i = 1; i <= nodes; i++)
+            {
+                Node node = new Node((byte)i, BlockRegisters * sensors, random.NextDouble() * TickMs);
+                node.Resync = resync;
+                bus.Nodes.Add(node);
+            }
+            ModbusMaster master = new ModbusMaster(bus, baudRate);
+            if (!gap)
+                master.GapMs = 0;
+
+            // Each sample must come once per scan, with the values of its registers
+            ModbusPoller poller = new ModbusPoller(master);
+            int[] samples = new int[ModbusPoller.MaxNodes + 1], bad = new int[ModbusPoller.MaxNodes + 1];
+            int[] offline = new int[ModbusPoller.MaxNodes + 1];
+            poller.SampleReceived += (node, sensor, status, temperature, humidity) =>
+            {
+                int block = sensor * BlockRegisters;
+                if (node > nodes || status != 0 || temperature != (block + ModbusPoller.IrTemperature) / 10.0f ||
+                        humidity != (block + ModbusPoller.IrHumidity) / 10.0f)
+                    bad[node]++;
+                else
+                    samples[node]++;
+            };
+            poller.NodeChanged += (node, online) =>
+            {
+                if (!online)
+                    offline[node]++;
+            };
+            for (int scan = 0; scan < scans; scan++)
+            {
+                foreach (Node node in bus.Nodes)
+                    node.Seq = (ushort)scan;
+                poller.Scan();
+            }
+
+            using (StreamWriter w = new StreamWriter("modbus.txt"))
+            {
+                w.WriteLine("{0} nodes of {1} sensors, {2} scans, {3} baud, gap {4} ms, {5}", nodes, sensors, scans,
+                    baudRate, master.GapMs, resync ? "resync" : "no resync");
+                int total = 0, totalBad = 0;
+                foreach (Node node in bus.Nodes)
+                {
+                    w.WriteLine("node {0}: {1} of {2} samples, {3} bad, {4} times offline, {5} requests executed",
+                        node.Address, samples[node.Address], scans * sensors, bad[node.Address], offline[node.Address],
+                        node.Executed);
+                    total += samples[node.Address];
+                    totalBad += bad[node.Address];
+                }
+                w.WriteLine("total: {0} of {1} samples, {2} bad", total, nodes * scans * sensors, totalBad);
+            }
+        }
+    }
+}
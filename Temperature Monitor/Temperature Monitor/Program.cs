@@ -10,10 +10,44 @@ namespace Temperature_Monitor
     {
         /// <summary>
         /// The main entry point for the application.
+        /// "/map file" writes the memory report of a firmware linker map to file.txt instead (MapReport).
+        /// "/replay ..." replays logic analyzer captures into the driver model instead (Replay).
+        /// "/collect [ports]" collects the samples of many devices instead, without the window (Collector).
+        /// "/filter" checks the arithmetic of the firmware's sample filter instead (FilterCheck).
+        /// "/modbus ..." runs the Modbus master against a model of a bus of nodes instead (ModbusBus).
         /// </summary>
         [STAThread]
-        static void Main()
+        static void Main(string[] args)
         {
+            if (args.Length == 2 && args[0] == "/map")
+            {
+                using (System.IO.StreamWriter w = new System.IO.StreamWriter(args[1] + ".txt"))
+                {
+                    MapReport.Parse(args[1]).Write(w);
+                }
+                return;
+            }
+            if (args.Length > 0 && args[0] == "/replay")
+            {
+                Replay.Report(args);
+                return;
+            }
+            if (args.Length > 0 && args[0] == "/collect")
+            {
+                Collector.Run(args);
+                return;
+            }
+            if (args.Length > 0 && args[0] == "/filter")
+            {
+                FilterCheck.Report(args);
+                return;
+            }
+            if (args.Length > 0 && args[0] == "/modbus")
+            {
+                ModbusBus.Report(args);
+                return;
+            }
+
             Application.EnableVisualStyles();
             Application.SetCompatibleTextRenderingDefault(false);
             Application.Run(new MainForm());
@@ -0,0 +1,856 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Text;
+
+namespace Temperature_Monitor
+{
+    /// <summary>
+    /// Serial protocol of the DHT22 device (see frame.h and command.h in the firmware).
+    /// Splits the received bytes into ASCII lines and binary frames, and builds the command frames.
+    /// </summary>
+    public class Protocol
+    {
+        public const byte FrameSync = 0xA5;
+        public const byte CmdSync = 0x5A;
+
+        // Frame types, device to host
+        public const byte FrameSample = 0x10;
+        public const byte FrameError = 0x11;
+        public const byte FrameHealth = 0x12;
+        public const byte FrameHist = 0x13;
+        public const byte FrameLog = 0x14;
+        public const byte FrameAggregate = 0x15;
+        public const byte FrameBatch = 0x16;
+        public const byte FrameKey = 0x17;
+        public const byte FrameDelta4 = 0x18;
+        public const byte FrameDelta8 = 0x19;
+        public const byte FrameTrace = 0x1A;
+        public const byte FrameReply = 0x80;
+
+        // Commands
+        public const byte CmdSetPeriod = 0x01;
+        public const byte CmdSetFormat = 0x02;
+        public const byte CmdEnableSensors = 0x03;
+        public const byte CmdDumpStats = 0x04;
+        public const byte CmdResetCounters = 0x05;
+        public const byte CmdDumpHist = 0x06;
+        public const byte CmdClearHist = 0x07;
+        public const byte CmdSetMode = 0x08;
+        public const byte CmdReadLast = 0x09;
+        public const byte CmdReadLastN = 0x0A;
+        public const byte CmdReadSince = 0x0B;
+        public const byte CmdDumpLog = 0x0C;
+        public const byte CmdSetBaud = 0x0D;
+        public const byte CmdSetDeadband = 0x0E;
+        public const byte CmdSetFilter = 0x0F;
+        public const byte CmdSetAggregate = 0x10;
+        public const byte CmdSetBatch = 0x11;
+        public const byte CmdNack = 0x12;
+        public const byte CmdTimeSync = 0x13;
+        public const byte CmdDumpProf = 0x14;
+        public const byte CmdClearProf = 0x15;
+        public const byte CmdIdentify = 0x16;
+        public const byte CmdSetId = 0x17;
+
+        public const int TickMs = 10; // Time unit of the batch offsets (ACQ_TICK_MS)
+        public const int WindowFrames = 16; // Frames the device can send again (FRAME_WINDOW_FRAMES)
+
+        // Reply status
+        public const byte CmdOk = 0;
+        public const byte CmdErrArg = 1;
+        public const byte CmdErrUnknown = 2;
+
+        // Output formats
+        public const byte FormatAscii = 0;
+        public const byte FormatBinary = 1;
+        public const byte FormatDelta = 2;
+
+        // Modes
+        public const byte ModeStream = 0;
+        public const byte ModePoll = 1;
+
+        /// <summary>
+        /// Cached record returned by the CmdReadXxx commands (CACHE_RECORD_t).
+        /// Status is 0 for a sample, the DHT22 error otherwise.
+        /// </summary>
+        public class Record
+        {
+            public const int Size = 8;
+
+            public ushort Seq;
+            public byte Sensor;
+            public byte Status;
+            public float Temperature;
+            public float Humidity;
+        }
+
+        /// <summary>
+        /// Sample of the EEPROM log (LOG_BLOCK_t), identified by its block and index in it.
+        /// Status is 0 for a sample, the DHT22 error otherwise. Time is the device clock (ms)
+        /// in the reset Boot, see LogDump.
+        /// </summary>
+        public class LogSample
+        {
+            public const int BlockSize = 32;
+            public const int SamplesPerBlock = 7;
+
+            public ushort Block;
+            public int Index;
+            public byte Sensor;
+            public byte Status;
+            public byte Boot;
+            public uint Time;
+            public float Temperature;
+            public float Humidity;
+        }
+
+        /// <summary>
+        /// Reply of CmdDumpLog: blocks sent, reset counter and device clock (ms) when it was sent.
+        /// </summary>
+        public class LogDump
+        {
+            public int Sent;
+            public byte Boot;
+            public uint Now;
+
+            /// <summary>
+            /// Wall time of a sample of the reset Boot, from the time the reply was received
+            /// (within 24 days of it).
+            /// </summary>
+            public DateTime TimeOf(LogSample s, DateTime received)
+            {
+                return received.AddMilliseconds((int)(s.Time - Now));
+            }
+        }
+
+        /// <summary>
+        /// Aggregate record of an interval. The means have one more decimal than the samples.
+        /// </summary>
+        public class Aggregate
+        {
+            public byte Sensor;
+            public int Count;
+            public int Errors;
+            public float TemperatureMin, TemperatureMax, TemperatureMean;
+            public float HumidityMin, HumidityMax, HumidityMean;
+
+            /// <summary>
+            /// Decodes "AGG,sensor,count,errors,tmin,tmax,tmean,hmin,hmax,hmean" (split at the commas).
+            /// </summary>
+            public static Aggregate FromLine(string[] data)
+            {
+                Aggregate a = new Aggregate();
+                a.Sensor = byte.Parse(data[1]);
+                a.Count = int.Parse(data[2]);
+                a.Errors = int.Parse(data[3]);
+                a.TemperatureMin = float.Parse(data[4], System.Globalization.CultureInfo.InvariantCulture);
+                a.TemperatureMax = float.Parse(data[5], System.Globalization.CultureInfo.InvariantCulture);
+                a.TemperatureMean = float.Parse(data[6], System.Globalization.CultureInfo.InvariantCulture);
+                a.HumidityMin = float.Parse(data[7], System.Globalization.CultureInfo.InvariantCulture);
+                a.HumidityMax = float.Parse(data[8], System.Globalization.CultureInfo.InvariantCulture);
+                a.HumidityMean = float.Parse(data[9], System.Globalization.CultureInfo.InvariantCulture);
+                return a;
+            }
+
+            /// <summary>
+            /// Decodes a FrameAggregate payload.
+            /// </summary>
+            public static Aggregate FromFrame(byte[] payload)
+            {
+                Aggregate a = new Aggregate();
+                a.Sensor = payload[0];
+                a.Count = BitConverter.ToUInt16(payload, 1);
+                a.Errors = BitConverter.ToUInt16(payload, 3);
+                a.TemperatureMin = BitConverter.ToInt16(payload, 5) / 10.0f;
+                a.TemperatureMax = BitConverter.ToInt16(payload, 7) / 10.0f;
+                a.TemperatureMean = BitConverter.ToInt16(payload, 9) / 100.0f;
+                a.HumidityMin = BitConverter.ToUInt16(payload, 11) / 10.0f;
+                a.HumidityMax = BitConverter.ToUInt16(payload, 13) / 10.0f;
+                a.HumidityMean = BitConverter.ToUInt16(payload, 15) / 100.0f;
+                return a;
+            }
+        }
+
+        /// <summary>
+        /// Entry of a FrameBatch. Time is the device clock (ms); Status is 0 for a sample.
+        /// </summary>
+        public class BatchEntry
+        {
+            public byte Sensor;
+            public byte Status;
+            public uint Time;
+            public float Temperature;
+            public float Humidity;
+        }
+
+        /// <summary>
+        /// Unpacks a FrameBatch payload: time of the first entry, count, entries (sensor, offset,
+        /// temperature or error, humidity).
+        /// </summary>
+        public static List<BatchEntry> ParseBatch(byte[] payload)
+        {
+            List<BatchEntry> entries = new List<BatchEntry>();
+            uint timeBase = BitConverter.ToUInt32(payload, 0);
+            for (int i = 0; i < payload[4] && 5 + (i + 1) * 6 <= payload.Length; i++)
+            {
+                int offset = 5 + i * 6;
+                BatchEntry e = new BatchEntry();
+                e.Sensor = (byte)(payload[offset] & 0x7F);
+                e.Time = (uint)(timeBase + payload[offset + 1] * TickMs);
+                short value = BitConverter.ToInt16(payload, offset + 2);
+                if ((payload[offset] & 0x80) != 0)
+                {
+                    e.Status = (byte)value;
+                }
+                else
+                {
+                    e.Temperature = value / 10.0f;
+                    e.Humidity = BitConverter.ToUInt16(payload, offset + 4) / 10.0f;
+                }
+                entries.Add(e);
+            }
+            return entries;
+        }
+
+        /// <summary>
+        /// Identity of a device (CmdIdentify reply). Id is NoId until the host gives one (CmdSetId).
+        /// </summary>
+        public class Identity
+        {
+            public const uint NoId = 0xFFFFFFFF;
+
+            public uint Id;
+            public int VersionMajor, VersionMinor;
+            public int Sensors;
+            public int Formats; // Bit n: format n (FormatAscii...)
+            public List<int> BaudRates = new List<int>();
+
+            /// <summary>
+            /// Decodes a CmdIdentify reply (status, id, version, sensors, formats, rates). Returns
+            /// null if it is not a valid one.
+            /// </summary>
+            public static Identity FromReply(byte[] payload)
+            {
+                if (payload.Length < 10 || payload[0] != CmdOk || payload.Length < 10 + 4 * payload[9])
+                    return null;
+                Identity i = new Identity();
+                i.Id = BitConverter.ToUInt32(payload, 1);
+                i.VersionMajor = payload[5];
+                i.VersionMinor = payload[6];
+                i.Sensors = payload[7];
+                i.Formats = payload[8];
+                for (int n = 0; n < payload[9]; n++)
+                    i.BaudRates.Add((int)BitConverter.ToUInt32(payload, 10 + 4 * n));
+                return i;
+            }
+        }
+
+        /// <summary>
+        /// Durations of a profiled section (PROF_STATS_t, prof.h), in CPU cycles.
+        /// </summary>
+        public class ProfStats
+        {
+            public const int Size = 10;
+
+            // Sections, in the order of the device (PROF_TIMER...)
+            public static readonly string[] Names = { "timer isr", "edge isr", "uart rx isr", "uart tx isr", "acquisition", "commands", "report" };
+
+            public int Id;
+            public int Count;
+            public int Min, Max;
+            public double Average;
+
+            public string Name
+            {
+                get { return Id < Names.Length ? Names[Id] : "section " + Id; }
+            }
+        }
+
+        /// <summary>
+        /// Entry of a FrameTrace (PROF_TRACE_t): a section run, Start is Timer1 when it began.
+        /// Cycles are Timer1 counts times the cycles per count of the CmdDumpProf reply.
+        /// </summary>
+        public class TraceEntry
+        {
+            public const int Size = 5;
+
+            public int Id;
+            public ushort Start;
+            public int Counts;
+        }
+
+        /// <summary>
+        /// Decodes a FrameTrace payload (count, entries), oldest first.
+        /// </summary>
+        public static List<TraceEntry> ParseTrace(byte[] payload)
+        {
+            List<TraceEntry> entries = new List<TraceEntry>();
+            for (int i = 0; i < payload[0] && 1 + (i + 1) * TraceEntry.Size <= payload.Length; i++)
+            {
+                int offset = 1 + i * TraceEntry.Size;
+                TraceEntry e = new TraceEntry();
+                e.Id = payload[offset];
+                e.Start = BitConverter.ToUInt16(payload, offset + 1);
+                e.Counts = BitConverter.ToUInt16(payload, offset + 3);
+                entries.Add(e);
+            }
+            return entries;
+        }
+
+        /// <summary>
+        /// Decodes a CmdDumpProf reply (status, cycles per count, sections, PROF_STATS_t each).
+        /// The sections never run are left out.
+        /// </summary>
+        public static List<ProfStats> ParseProf(byte[] payload)
+        {
+            List<ProfStats> stats = new List<ProfStats>();
+            if (payload.Length < 3 || payload[0] != CmdOk)
+                return stats;
+            int cycles = payload[1];
+            for (int i = 0; i < payload[2] && 3 + (i + 1) * ProfStats.Size <= payload.Length; i++)
+            {
+                int offset = 3 + i * ProfStats.Size;
+                ProfStats p = new ProfStats();
+                p.Id = i;
+                p.Count = BitConverter.ToUInt16(payload, offset);
+                if (p.Count == 0)
+                    continue;
+                p.Min = BitConverter.ToUInt16(payload, offset + 2) * cycles;
+                p.Max = BitConverter.ToUInt16(payload, offset + 4) * cycles;
+                p.Average = (double)BitConverter.ToUInt32(payload, offset + 6) * cycles / p.Count;
+                stats.Add(p);
+            }
+            return stats;
+        }
+
+        /// <summary>
+        /// Decoder of the delta format: keeps the last sample and sequence number of each
+        /// sensor. A delta with an unexpected sequence number (a frame was lost) or without
+        /// a previous key frame is dropped, and the sensor waits for the next key frame.
+        /// </summary>
+        public class DeltaDecoder
+        {
+            const int Sensors = 16;
+
+            bool[] synced = new bool[Sensors];
+            int[] seq = new int[Sensors];
+            int[] temperature = new int[Sensors];
+            int[] humidity = new int[Sensors];
+
+            /// <summary>Deltas dropped because of a lost frame.</summary>
+            public int Lost;
+
+            /// <summary>
+            /// Decodes a FrameKey, FrameDelta4 or FrameDelta8 payload. Returns false if the
+            /// sample cannot be rebuilt.
+            /// </summary>
+            public bool Decode(byte type, byte[] payload, out int sensor, out float t, out float h)
+            {
+                t = h = 0;
+                if (type == FrameKey)
+                {
+                    sensor = payload[0] & (Sensors - 1);
+                    seq[sensor] = payload[1] & 0x0F;
+                    temperature[sensor] = BitConverter.ToInt16(payload, 2);
+                    humidity[sensor] = BitConverter.ToUInt16(payload, 4);
+                    synced[sensor] = true;
+                }
+                else
+                {
+                    sensor = payload[0] >> 4;
+                    int next = (seq[sensor] + 1) & 0x0F;
+                    if (!synced[sensor] || (payload[0] & 0x0F) != next)
+                    {
+                        if (synced[sensor])
+                            Lost++;
+                        synced[sensor] = false;
+                        return false;
+                    }
+                    seq[sensor] = next;
+                    if (type == FrameDelta4)
+                    {
+                        temperature[sensor] += (sbyte)payload[1] >> 4;
+                        humidity[sensor] += (sbyte)(payload[1] << 4) >> 4;
+                    }
+                    else
+                    {
+                        temperature[sensor] += (sbyte)payload[1];
+                        humidity[sensor] += (sbyte)payload[2];
+                    }
+                }
+                t = temperature[sensor] / 10.0f;
+                h = humidity[sensor] / 10.0f;
+                return true;
+            }
+        }
+
+        public delegate void LineHandler(string line);
+        public delegate void FrameHandler(byte type, byte[] payload);
+        public delegate void SendHandler(byte[] frame);
+
+        public event LineHandler LineReceived;
+        public event FrameHandler FrameReceived;
+
+        /// <summary>Raised with a CmdNack frame the caller must send to the device.</summary>
+        public event SendHandler SendRequested;
+
+        /// <summary>Frames dropped because of a bad CRC.</summary>
+        public int Corrupted;
+        /// <summary>Numbered frames received again after a NACK.</summary>
+        public int Recovered;
+        /// <summary>Numbered frames that were never received.</summary>
+        public int Lost;
+
+        enum State { Line, Type, Length, Seq, Payload, CrcLow, CrcHigh }
+
+        const int HoldMax = 2 * WindowFrames; // Frames held back waiting for a retransmission
+
+        State state = State.Line;
+        StringBuilder line = new StringBuilder();
+        byte type;
+        byte[] payload;
+        int pos;
+        byte seq;
+        ushort crc;
+
+        // Link layer: numbered frames are delivered in sequence order. After a gap the
+        // next ones are held until the missing ones are sent again or the device
+        // answers the NACKs (then the frames still missing are lost).
+        bool linked;
+        byte next; // Sequence number of the next frame to deliver
+        byte highest; // Highest sequence number received
+        int nacksPending;
+        bool retried; // The missing frames were asked for a second time
+        Dictionary<byte, KeyValuePair<byte, byte[]>> held = new Dictionary<byte, KeyValuePair<byte, byte[]>>();
+
+        /// <summary>
+        /// Whether the frame type is numbered by the device (FRAME_NUMBERED in frame.h).
+        /// </summary>
+        public static bool IsNumbered(byte type)
+        {
+            return type < FrameReply && type != FrameLog && type != FrameHist && type != FrameTrace;
+        }
+
+        /// <summary>
+        /// CRC-16 of the frames (polynomial 0xA001, initial value 0xFFFF), one byte at a time.
+        /// </summary>
+        public static ushort CrcUpdate(ushort crc, byte data)
+        {
+            crc ^= data;
+            for (int n = 0; n < 8; n++)
+                crc = (ushort)((crc & 1) != 0 ? (crc >> 1) ^ 0xA001 : crc >> 1);
+            return crc;
+        }
+
+        /// <summary>
+        /// Decodes the received bytes. Raises LineReceived for each complete line
+        /// (without the "\n") and FrameReceived for each frame with a valid CRC,
+        /// numbered frames in sequence order.
+        /// </summary>
+        public void Feed(byte[] buffer, int count)
+        {
+            for (int i = 0; i < count; i++)
+            {
+                byte b = buffer[i];
+                switch (state)
+                {
+                    case State.Line:
+                        if (b == FrameSync)
+                        {
+                            line.Length = 0;
+                            state = State.Type;
+                        }
+                        else if (b == '\n')
+                        {
+                            string text = line.ToString().TrimEnd('\r');
+                            line.Length = 0;
+                            if (text.Length > 0 && LineReceived != null)
+                                LineReceived(text);
+                        }
+                        else
+                        {
+                            line.Append((char)b);
+                        }
+                        break;
+                    case State.Type:
+                        type = b;
+                        crc = CrcUpdate(0xFFFF, b);
+                        state = State.Length;
+                        break;
+                    case State.Length:
+                        payload = new byte[b];
+                        pos = 0;
+                        crc = CrcUpdate(crc, b);
+                        state = State.Seq;
+                        break;
+                    case State.Seq:
+                        seq = b;
+                        crc = CrcUpdate(crc, b);
+                        state = (payload.Length > 0) ? State.Payload : State.CrcLow;
+                        break;
+                    case State.Payload:
+                        payload[pos++] = b;
+                        crc = CrcUpdate(crc, b);
+                        if (pos == payload.Length)
+                            state = State.CrcLow;
+                        break;
+                    case State.CrcLow:
+                        crc = CrcUpdate(crc, b);
+                        state = State.CrcHigh;
+                        break;
+                    case State.CrcHigh:
+                        state = State.Line;
+                        if (CrcUpdate(crc, b) != 0)
+                            Corrupted++; // The gap in the sequence numbers recovers it
+                        else if (IsNumbered(type))
+                            Receive(seq, type, payload);
+                        else if (type == (FrameReply | CmdNack))
+                            NackReply();
+                        else
+                            Deliver(type, payload);
+                        break;
+                }
+            }
+        }
+
+        void Deliver(byte type, byte[] payload)
+        {
+            if (FrameReceived != null)
+                FrameReceived(type, payload);
+        }
+
+        void Receive(byte seq, byte type, byte[] payload)
+        {
+            int pending = (byte)(highest - next);
+            if (linked && (byte)(seq - next) < pending)
+            {
+                // Sent again after a NACK
+                if (held.ContainsKey(seq))
+                    return;
+                Recovered++;
+                held[seq] = new KeyValuePair<byte, byte[]>(type, payload);
+                Drain();
+                return;
+            }
+            if (!linked || (byte)(seq - highest) >= 128 && (byte)(next - seq) > 2 * HoldMax)
+            {
+                // First frame, or the device restarted its numbering
+                Flush();
+                linked = true;
+                next = highest = seq;
+            }
+            else if ((byte)(seq - highest) >= 128)
+            {
+                return; // Already delivered
+            }
+
+            int missing = (byte)(seq - highest);
+            if (missing == 0 && pending == 0)
+            {
+                Deliver(type, payload);
+                next = highest = (byte)(seq + 1);
+                return;
+            }
+            if (missing > 0 && SendRequested != null)
+            {
+                // Ask for the missing frames the device can still have
+                missing = Math.Min(missing, WindowFrames);
+                nacksPending++;
+                SendRequested(Nack((byte)(seq - missing), (byte)missing));
+            }
+            held[seq] = new KeyValuePair<byte, byte[]>(type, payload);
+            highest = (byte)(seq + 1);
+            if (nacksPending == 0 || (byte)(highest - next) > HoldMax)
+                Flush();
+        }
+
+        void NackReply()
+        {
+            if (nacksPending == 0 || --nacksPending > 0)
+                return;
+            int pending = (byte)(highest - next);
+            if (!retried && pending > 0 && pending <= WindowFrames && SendRequested != null)
+            {
+                // The retransmission can be hit too: ask once more for what is still missing
+                // (nothing if all came, the device rejects a count of 0)
+                retried = true;
+                nacksPending++;
+                SendRequested(Nack(next, (byte)pending));
+                return;
+            }
+            Flush();
+        }
+
+        /// <summary>Delivers the held frames that are now in sequence.</summary>
+        void Drain()
+        {
+            KeyValuePair<byte, byte[]> frame;
+            while (next != highest && held.TryGetValue(next, out frame))
+            {
+                held.Remove(next);
+                next++;
+                Deliver(frame.Key, frame.Value);
+            }
+        }
+
+        /// <summary>Gives up on the missing frames and delivers all the held ones.</summary>
+        void Flush()
+        {
+            KeyValuePair<byte, byte[]> frame;
+            while (next != highest)
+            {
+                if (held.TryGetValue(next, out frame))
+                    Deliver(frame.Key, frame.Value);
+                else
+                    Lost++;
+                next++;
+            }
+            held.Clear();
+            nacksPending = 0;
+            retried = false;
+        }
+
+        /// <summary>
+        /// Builds a command frame: CmdSync, cmd, length, payload, CRC (low byte first).
+        /// </summary>
+        public static byte[] Command(byte cmd, params byte[] data)
+        {
+            byte[] frame = new byte[data.Length + 5];
+            frame[0] = CmdSync;
+            frame[1] = cmd;
+            frame[2] = (byte)data.Length;
+            Array.Copy(data, 0, frame, 3, data.Length);
+            ushort crc = 0xFFFF;
+            for (int i = 1; i < frame.Length - 2; i++)
+                crc = CrcUpdate(crc, frame[i]);
+            frame[frame.Length - 2] = (byte)crc;
+            frame[frame.Length - 1] = (byte)(crc >> 8);
+            return frame;
+        }
+
+        public static byte[] SetPeriod(int periodMs)
+        {
+            return Command(CmdSetPeriod, (byte)periodMs, (byte)(periodMs >> 8));
+        }
+
+        public static byte[] SetFormat(byte format)
+        {
+            return Command(CmdSetFormat, format);
+        }
+
+        public static byte[] EnableSensors(byte mask)
+        {
+            return Command(CmdEnableSensors, mask);
+        }
+
+        public static byte[] DumpStats(byte sensor)
+        {
+            return Command(CmdDumpStats, sensor);
+        }
+
+        public static byte[] ResetCounters()
+        {
+            return Command(CmdResetCounters);
+        }
+
+        public static byte[] SetMode(byte mode)
+        {
+            return Command(CmdSetMode, mode);
+        }
+
+        public static byte[] ReadLast(byte sensor)
+        {
+            return Command(CmdReadLast, sensor);
+        }
+
+        public static byte[] ReadLastN(byte n)
+        {
+            return Command(CmdReadLastN, n);
+        }
+
+        public static byte[] ReadSince(ushort seq)
+        {
+            return Command(CmdReadSince, (byte)seq, (byte)(seq >> 8));
+        }
+
+        public static byte[] SetBaud(int rate)
+        {
+            return Command(CmdSetBaud, (byte)rate, (byte)(rate >> 8), (byte)(rate >> 16), (byte)(rate >> 24));
+        }
+
+        /// <summary>
+        /// Report by exception: deadbands in 0.1 C and 0.1 %, heartbeat in seconds (0 sends every sample).
+        /// </summary>
+        public static byte[] SetDeadband(int temperature, int humidity, int heartbeat)
+        {
+            return Command(CmdSetDeadband, (byte)temperature, (byte)(temperature >> 8),
+                (byte)humidity, (byte)(humidity >> 8), (byte)heartbeat, (byte)(heartbeat >> 8));
+        }
+
+        /// <summary>
+        /// Sample filter: median of 1, 3 or 5 samples, then EWMA with factor alpha / 256 (256 = off).
+        /// </summary>
+        public static byte[] SetFilter(byte median, int alpha)
+        {
+            return Command(CmdSetFilter, median, (byte)alpha, (byte)(alpha >> 8));
+        }
+
+        /// <summary>
+        /// Aggregation interval in seconds (0 sends every sample).
+        /// </summary>
+        public static byte[] SetAggregate(int seconds)
+        {
+            return Command(CmdSetAggregate, (byte)seconds, (byte)(seconds >> 8));
+        }
+
+        /// <summary>
+        /// Batching of the binary samples: entries per frame (0 or 1 disables) and maximum latency in ms.
+        /// </summary>
+        public static byte[] SetBatch(byte samples, int latencyMs)
+        {
+            return Command(CmdSetBatch, samples, (byte)latencyMs, (byte)(latencyMs >> 8));
+        }
+
+        /// <summary>
+        /// One exchange of the clock synchronization (see TimeSync): the host time is echoed.
+        /// </summary>
+        public static byte[] SyncTime(uint hostMs)
+        {
+            return Command(CmdTimeSync, (byte)hostMs, (byte)(hostMs >> 8), (byte)(hostMs >> 16), (byte)(hostMs >> 24));
+        }
+
+        /// <summary>
+        /// Asks the device to send the numbered frames seq to seq + count - 1 again.
+        /// </summary>
+        public static byte[] Nack(byte seq, byte count)
+        {
+            return Command(CmdNack, seq, count);
+        }
+
+        /// <summary>
+        /// Asks for the profiling trace (FrameTrace frames) and statistics (reply). Firmware
+        /// built without PROF_ENABLE answers CmdErrUnknown.
+        /// </summary>
+        public static byte[] DumpProf()
+        {
+            return Command(CmdDumpProf);
+        }
+
+        public static byte[] ClearProf()
+        {
+            return Command(CmdClearProf);
+        }
+
+        public static byte[] Identify()
+        {
+            return Command(CmdIdentify);
+        }
+
+        public static byte[] SetId(uint id)
+        {
+            return Command(CmdSetId, (byte)id, (byte)(id >> 8), (byte)(id >> 16), (byte)(id >> 24));
+        }
+
+        public static byte[] DumpLog()
+        {
+            return Command(CmdDumpLog);
+        }
+
+        public static byte[] DumpLog(ushort seq)
+        {
+            return Command(CmdDumpLog, (byte)seq, (byte)(seq >> 8));
+        }
+
+        /// <summary>
+        /// Decodes the reply of CmdDumpLog, null if it is not CmdOk.
+        /// </summary>
+        public static LogDump ParseLogDump(byte[] payload)
+        {
+            if (payload.Length < 8 || payload[0] != CmdOk)
+                return null;
+            LogDump d = new LogDump();
+            d.Sent = BitConverter.ToUInt16(payload, 1);
+            d.Boot = payload[3];
+            d.Now = BitConverter.ToUInt32(payload, 4);
+            return d;
+        }
+
+        /// <summary>
+        /// Decodes the samples of a FrameLog frame (count, blocks). The first sample of a
+        /// block is absolute, the next ones are deltas to the previous sample (0x80 = error)
+        /// with the seconds since it.
+        /// </summary>
+        public static List<LogSample> ParseLog(byte[] payload)
+        {
+            List<LogSample> samples = new List<LogSample>();
+            for (int i = 0; i < payload[0] && 1 + (i + 1) * LogSample.BlockSize <= payload.Length; i++)
+            {
+                int offset = 1 + i * LogSample.BlockSize;
+                ushort seq = BitConverter.ToUInt16(payload, offset);
+                byte sensor = payload[offset + 2];
+                int count = Math.Min((int)payload[offset + 3], LogSample.SamplesPerBlock);
+                byte boot = payload[offset + 4];
+                uint time = BitConverter.ToUInt32(payload, offset + 5);
+                short t = BitConverter.ToInt16(payload, offset + 9);
+                int h = BitConverter.ToUInt16(payload, offset + 11);
+                bool valid = t != short.MinValue;
+                for (int n = 0; n < count; n++)
+                {
+                    LogSample s = new LogSample();
+                    s.Block = seq;
+                    s.Index = n;
+                    s.Sensor = sensor;
+                    if (n == 0)
+                    {
+                        s.Status = valid ? (byte)0 : (byte)h;
+                    }
+                    else
+                    {
+                        int delta = offset + 13 + (n - 1) * 3;
+                        sbyte dt = (sbyte)payload[delta];
+                        sbyte dh = (sbyte)payload[delta + 1];
+                        time += payload[delta + 2] * 1000u;
+                        if (dt == sbyte.MinValue)
+                        {
+                            s.Status = (byte)dh;
+                        }
+                        else
+                        {
+                            t += dt;
+                            h += dh;
+                        }
+                    }
+                    s.Boot = boot;
+                    s.Time = time;
+                    s.Temperature = t / 10.0f;
+                    s.Humidity = h / 10.0f;
+                    if (valid || s.Status != 0)
+                        samples.Add(s);
+                }
+            }
+            return samples;
+        }
+
+        /// <summary>
+        /// Decodes the records of a CmdReadXxx reply (status, count, records), oldest first.
+        /// </summary>
+        public static List<Record> ParseRecords(byte[] payload)
+        {
+            List<Record> records = new List<Record>();
+            if (payload.Length < 2 || payload[0] != CmdOk)
+                return records;
+            for (int i = 0; i < payload[1] && 2 + (i + 1) * Record.Size <= payload.Length; i++)
+            {
+                int offset = 2 + i * Record.Size;
+                Record r = new Record();
+                r.Seq = BitConverter.ToUInt16(payload, offset);
+                r.Sensor = payload[offset + 2];
+                r.Status = payload[offset + 3];
+                r.Temperature = BitConverter.ToInt16(payload, offset + 4) / 10.0f;
+                r.Humidity = BitConverter.ToUInt16(payload, offset + 6) / 10.0f;
+                records.Add(r);
+            }
+            return records;
+        }
+    }
+}
@@ -0,0 +1,401 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Globalization;
+using System.IO;
+
+namespace Temperature_Monitor
+{
+    /// <summary>
+    /// Replays logic analyzer captures of the DHT22 line into a model of the interrupt driven
+    /// driver (DHT22int.c), so a decoding failure seen on site can be reproduced from its real
+    /// edge timings and the thresholds evaluated against a corpus of captures.
+    /// Run "Temperature Monitor.exe /replay [/tick 1|2] [/threshold us] [/fixed] [/vcd] files":
+    /// the result of each reading is written to replay.txt, with the totals per status.
+    ///
+    /// The model follows the driver's state machine: the widths are counted in timer ticks
+    /// (DHT22_TICK_US) from one selected edge to the next (rising edge for the sensor ACK low,
+    /// then falling edges), with the same windows, bit threshold and timeouts (256 ticks without
+    /// an edge). The interrupt latency is not modeled. The blocking driver (DHT22.c) counts loop
+    /// iterations and is not modeled.
+    /// </summary>
+    public class Replay
+    {
+        // Result of a reading (DHT22_STATUS_t)
+        public const int DataReady = 0;
+        public const int ErrorChecksum = 6;
+        public static readonly string[] StatusNames = { "ok", "bus hung", "not present", "ack too long", "sync timeout", "data timeout", "checksum" };
+        const int BusHung = 1, NotPresent = 2, AckTooLong = 3, DataTimeout = 5;
+
+        const double HostStartUs = 300; // A low pulse longer than this is the host start (P1)
+
+        /// <summary>Level change of the line, time in ns from the start of the capture.</summary>
+        public struct Edge
+        {
+            public long Time;
+            public bool Level;
+
+            public Edge(long time, bool level)
+            {
+                Time = time;
+                Level = level;
+            }
+        }
+
+        /// <summary>Result of one reading of a capture.</summary>
+        public class Reading
+        {
+            public long Start; // ns, end of the host start pulse
+            public int Status;
+            public int Bits;
+            public byte[] Frame = new byte[5];
+            public int Threshold; // Bit threshold used (ticks)
+            public float Temperature;
+            public float Humidity;
+        }
+
+        // Driver settings (DHT22int.h)
+        public int TickUs = 2;
+        public bool Adaptive = true; // DHT22_ADAPTIVE_THRESHOLD
+        public int ThresholdUs = 110; // DHT22_BIT_THRESHOLD
+
+        public List<Reading> Readings = new List<Reading>();
+
+        // Pin activity of the model, for the VCD export
+        class Mark
+        {
+            public long Time;
+            public char Signal;
+            public char Value;
+
+            public Mark(long time, char signal, char value)
+            {
+                Time = time;
+                Signal = signal;
+                Value = value;
+            }
+        }
+        List<Mark> marks = new List<Mark>();
+        const long MarkNs = 1000; // Width of the handler markers (they only show when a handler runs)
+
+        void Pulse(long time, char signal)
+        {
+            marks.Add(new Mark(time, signal, '1'));
+            marks.Add(new Mark(time + MarkNs, signal, '0'));
+        }
+
+        int Ticks(int us)
+        {
+            return us / TickUs; // DHT22_US()
+        }
+
+        /// <summary>
+        /// Reads a capture: VCD (first 1 bit signal, or the one named signal) or CSV of
+        /// "time (s),level" lines, other columns and the lines that do not parse are skipped.
+        /// The line is idle (high) before the first sample; x and z are high (pull-up).
+        /// </summary>
+        public static List<Edge> Load(string path, string signal)
+        {
+            List<Edge> edges = new List<Edge>();
+            bool level = true;
+            if (path.EndsWith(".vcd", StringComparison.OrdinalIgnoreCase))
+            {
+                string[] words = File.ReadAllText(path).Split((char[])null, StringSplitOptions.RemoveEmptyEntries);
+                double scale = 1; // ns per VCD time unit
+                string id = null;
+                long time = 0;
+                for (int i = 0; i < words.Length; i++)
+                {
+                    string w = words[i];
+                    if (w == "$timescale")
+                    {
+                        string ts = "";
+                        while (++i < words.Length && words[i] != "$end")
+                            ts += words[i];
+                        scale = TimeScale(ts);
+                    }
+                    else if (w == "$var" && i + 4 < words.Length)
+                    {
+                        // $var wire 1 <id> <name> $end
+                        if (id == null && words[i + 2] == "1" && (signal == null || words[i + 4] == signal))
+                            id = words[i + 3];
+                        i += 4;
+                    }
+                    else if (w[0] == '#')
+                    {
+                        time = (long)(long.Parse(w.Substring(1)) * scale);
+                    }
+                    else if (id != null && w.Length > 1 && "01xXzZ".IndexOf(w[0]) >= 0 && w.Substring(1) == id)
+                    {
+                        Add(edges, ref level, time, w[0] != '0');
+                    }
+                }
+            }
+            else
+            {
+                foreach (string line in File.ReadAllLines(path))
+                {
+                    string[] data = line.Split(',');
+                    double seconds;
+                    int value;
+                    if (data.Length < 2 || !double.TryParse(data[0], NumberStyles.Float, CultureInfo.InvariantCulture, out seconds) ||
+                        !int.TryParse(data[1].Trim(), out value))
+                        continue;
+                    Add(edges, ref level, (long)Math.Round(seconds * 1e9), value != 0);
+                }
+            }
+            return edges;
+        }
+
+        static void Add(List<Edge> edges, ref bool level, long time, bool value)
+        {
+            if (value == level)
+                return;
+            level = value;
+            edges.Add(new Edge(time, value));
+        }
+
+        static double TimeScale(string ts)
+        {
+            int n = 0;
+            while (n < ts.Length && char.IsDigit(ts[n]))
+                n++;
+            double value = n > 0 ? double.Parse(ts.Substring(0, n), CultureInfo.InvariantCulture) : 1;
+            switch (ts.Substring(n))
+            {
+                case "s": return value * 1e9;
+                case "ms": return value * 1e6;
+                case "us": return value * 1e3;
+                case "ps": return value * 1e-3;
+                case "fs": return value * 1e-6;
+                default: return value; // ns
+            }
+        }
+
+        /// <summary>
+        /// Runs the driver model over the capture. Each host start pulse begins a reading; a
+        /// capture without one is read from its first edge (the sensor ACK).
+        /// </summary>
+        public void Run(List<Edge> edges)
+        {
+            long tickNs = TickUs * 1000L;
+            int i = 0;
+            while (i < edges.Count)
+            {
+                // Host start: falling edge, then the rising edge at least HostStartUs later
+                long release;
+                if (i + 1 < edges.Count && !edges[i].Level && edges[i + 1].Time - edges[i].Time > HostStartUs * 1000)
+                {
+                    long rise = edges[i + 1].Time;
+                    marks.Add(new Mark(edges[i].Time, 'd', '1'));
+                    release = rise + (Ticks(40) + 1) * tickNs; // P2, the timer is in CTC (OCR + 1 ticks)
+                    marks.Add(new Mark(release, 'd', '0'));
+                    Pulse(rise - 256 * tickNs, 't'); // First overflow of P1
+                    Pulse(rise, 't');
+                    Pulse(release, 't');
+                    i += 2;
+                }
+                else
+                {
+                    release = edges[i].Time;
+                }
+                i = Read(edges, i, release);
+            }
+        }
+
+        // One reading from the release of the line: returns the index of the first edge after it
+        int Read(List<Edge> edges, int i, long release)
+        {
+            long tickNs = TickUs * 1000L;
+            long timeout = 256 * tickNs; // OCR 255 in CTC
+            Reading r = new Reading();
+            r.Start = release;
+            r.Threshold = Ticks(ThresholdUs);
+            int state = NotPresent; // Named after the error if the timer fires: sensor response, ACK high, data
+            int ackLow = 0;
+            int shift = 1, index = 0;
+            long last = release; // Timer restarted at the last handled edge
+
+            for (; ; i++)
+            {
+                if (i >= edges.Count || edges[i].Time - last >= timeout)
+                {
+                    // Timer compare: too much time without the expected edge
+                    r.Status = state;
+                    if (state == NotPresent && i > 0 && !edges[i - 1].Level)
+                        r.Status = BusHung; // The line is still low
+                    Pulse(last + timeout, 't');
+                    break;
+                }
+                Edge e = edges[i];
+                if (e.Level != (state == NotPresent))
+                    continue; // Not the selected edge, no interrupt
+                int width = (int)((e.Time - last) / tickNs);
+                last = e.Time;
+                Pulse(e.Time, 'e');
+
+                if (state == DataTimeout)
+                {
+                    if (width <= Ticks(50) || width > Ticks(160))
+                        continue;
+                    bool byteDone = (shift & 0x80) != 0;
+                    shift = (shift << 1) & 0xFF;
+                    if (width > r.Threshold)
+                        shift |= 1;
+                    marks.Add(new Mark(e.Time, 'b', (shift & 1) != 0 ? '1' : '0'));
+                    r.Bits++;
+                    if (byteDone)
+                    {
+                        r.Frame[index++] = (byte)shift;
+                        shift = 1;
+                        if (index == r.Frame.Length)
+                        {
+                            marks.Add(new Mark(e.Time, 'b', 'x'));
+                            Decode(r);
+                            i++;
+                            break;
+                        }
+                    }
+                }
+                else if (state == NotPresent)
+                {
+                    if (width > Ticks(60) && width < Ticks(100))
+                    {
+                        ackLow = width;
+                        state = AckTooLong;
+                    }
+                }
+                else if (width > Ticks(60) && width < Ticks(100))
+                {
+                    if (Adaptive)
+                        r.Threshold = Math.Min(Math.Max(((ackLow + width) * 11) >> 4, Ticks(90)), Ticks(114)); // DHT22_BIT_THRESHOLD_MIN/MAX
+                    state = DataTimeout;
+                }
+            }
+
+            // The rest of the transaction (the sensor's last pulse) until the next host start
+            while (i < edges.Count && !(edges[i].Level == false && i + 1 < edges.Count &&
+                edges[i + 1].Time - edges[i].Time > HostStartUs * 1000))
+                i++;
+            Readings.Add(r);
+            return i;
+        }
+
+        static void Decode(Reading r)
+        {
+            byte[] f = r.Frame;
+            if (f[4] != (byte)(f[0] + f[1] + f[2] + f[3]))
+            {
+                r.Status = ErrorChecksum;
+                return;
+            }
+            r.Status = DataReady;
+            int t = (f[2] << 8) | f[3];
+            r.Temperature = ((t & 0x8000) != 0 ? -(t & 0x7FFF) : t) / 10.0f;
+            r.Humidity = ((f[0] << 8) | f[1]) / 10.0f;
+        }
+
+        /// <summary>
+        /// Writes the replayed line and the pin activity of the model as VCD (1 ns time unit):
+        /// the line, drive (the driver holds the line low or high, host start), timer and edge
+        /// (a pulse each time the handler runs, like the PROF_TIMER and PROF_EDGE markers of
+        /// prof.h) and bit (each data bit decided, x after the last one).
+        /// </summary>
+        public void WriteVcd(TextWriter w, List<Edge> edges)
+        {
+            w.WriteLine("$timescale 1ns $end");
+            w.WriteLine("$scope module dht22 $end");
+            w.WriteLine("$var wire 1 l line $end");
+            w.WriteLine("$var wire 1 d drive $end");
+            w.WriteLine("$var wire 1 t timer $end");
+            w.WriteLine("$var wire 1 e edge $end");
+            w.WriteLine("$var wire 1 b bit $end");
+            w.WriteLine("$upscope $end");
+            w.WriteLine("$enddefinitions $end");
+            w.WriteLine("#0");
+            w.WriteLine("$dumpvars 1l 0d 0t 0e xb $end");
+
+            List<Mark> all = new List<Mark>(marks);
+            foreach (Edge e in edges)
+                all.Add(new Mark(e.Time, 'l', e.Level ? '1' : '0'));
+            // Stable sort by time, the model's marks before the line at the same time
+            List<KeyValuePair<int, Mark>> order = new List<KeyValuePair<int, Mark>>();
+            for (int n = 0; n < all.Count; n++)
+                order.Add(new KeyValuePair<int, Mark>(n, all[n]));
+            order.Sort((a, b) => a.Value.Time != b.Value.Time ? a.Value.Time.CompareTo(b.Value.Time) : a.Key.CompareTo(b.Key));
+
+            long time = 0;
+            foreach (KeyValuePair<int, Mark> m in order)
+            {
+                if (m.Value.Time != time)
+                {
+                    time = m.Value.Time;
+                    w.WriteLine("#" + time);
+                }
+                w.WriteLine("" + m.Value.Value + m.Value.Signal);
+            }
+        }
+
+        /// <summary>
+        /// Replays each capture with the settings in args and writes replay.txt: one line per
+        /// reading (file, start (us), status, bits, threshold (us), frame, temperature, humidity)
+        /// and the totals per status. With /vcd each capture's pin activity goes to file.sim.vcd.
+        /// </summary>
+        public static void Report(string[] args)
+        {
+            Replay settings = new Replay();
+            bool vcd = false;
+            string signal = null;
+            List<string> files = new List<string>();
+            for (int n = 1; n < args.Length; n++)
+            {
+                if (args[n] == "/tick" && n + 1 < args.Length)
+                    settings.TickUs = int.Parse(args[++n]);
+                else if (args[n] == "/threshold" && n + 1 < args.Length)
+                    settings.ThresholdUs = int.Parse(args[++n]);
+                else if (args[n] == "/fixed")
+                    settings.Adaptive = false;
+                else if (args[n] == "/signal" && n + 1 < args.Length)
+                    signal = args[++n];
+                else if (args[n] == "/vcd")
+                    vcd = true;
+                else
+                    files.Add(args[n]);
+            }
+
+            int[] totals = new int[StatusNames.Length];
+            using (StreamWriter w = new StreamWriter("replay.txt"))
+            {
+                w.WriteLine("Tick {0} us, threshold {1} ({2} us)", settings.TickUs,
+                    settings.Adaptive ? "adaptive" : "fixed", settings.ThresholdUs);
+                foreach (string file in files)
+                {
+                    Replay replay = new Replay();
+                    replay.TickUs = settings.TickUs;
+                    replay.ThresholdUs = settings.ThresholdUs;
+                    replay.Adaptive = settings.Adaptive;
+                    List<Edge> edges = Load(file, signal);
+                    replay.Run(edges);
+                    foreach (Reading r in replay.Readings)
+                    {
+                        w.WriteLine(String.Format(CultureInfo.InvariantCulture, "{0},{1},{2},{3},{4},{5},{6},{7}",
+                            Path.GetFileName(file), r.Start / 1000, StatusNames[r.Status], r.Bits, r.Threshold * replay.TickUs,
+                            BitConverter.ToString(r.Frame), r.Temperature, r.Humidity));
+                        totals[r.Status]++;
+                    }
+                    if (vcd)
+                    {
+                        using (StreamWriter v = new StreamWriter(file + ".sim.vcd"))
+                        {
+                            replay.WriteVcd(v, edges);
+                        }
+                    }
+                }
+                for (int n = 0; n < totals.Length; n++)
+                {
+                    if (totals[n] > 0)
+                        w.WriteLine("{0}: {1}", StatusNames[n], totals[n]);
+                }
+            }
+        }
+    }
+}
@@ -0,0 +1,169 @@
+﻿using System;
+using System.Collections.Generic;
+using System.Diagnostics;
+
+namespace Temperature_Monitor
+{
+    /// <summary>
+    /// Synchronization of the device clock (clock.h in the firmware) with the host, NTP-like
+    /// over the serial link (CmdTimeSync). Each round is a few exchanges, the one with the
+    /// shortest round trip is kept; the drift is the slope of the offsets of the last rounds.
+    /// The host times come from a Stopwatch, so they do not depend on the UI thread.
+    /// </summary>
+    public class TimeSync
+    {
+        const int Exchanges = 4; // Per round
+        const int MaxRounds = 16; // Rounds kept for the drift
+        const double UnknownDrift = 100e-6; // Crystal tolerance, until the drift is estimated
+        const double Resolution = 1.0; // ms, both clocks count whole milliseconds
+
+        static readonly Stopwatch watch = Stopwatch.StartNew();
+        static readonly DateTime origin = DateTime.Now;
+
+        /// <summary>Host clock (ms), monotonic.</summary>
+        public static long HostMs
+        {
+            get { return watch.ElapsedMilliseconds; }
+        }
+
+        /// <summary>Wall clock time of a host clock value.</summary>
+        public static DateTime WallClock(double hostMs)
+        {
+            return origin.AddMilliseconds(hostMs);
+        }
+
+        class Round
+        {
+            public long Device; // Device time of the exchange (unwrapped)
+            public double Offset; // Host time - device time (ms)
+            public double Bound; // Error bound of Offset (ms)
+        }
+
+        List<Round> rounds = new List<Round>();
+        Round best;
+        int exchanges;
+        double drift; // Host ms per device ms, minus 1
+        double driftBound = UnknownDrift;
+        long device; // Last device time seen (unwrapped)
+        bool deviceSeen;
+        object syncLock = new object();
+
+        /// <summary>Whether at least one round is complete.</summary>
+        public bool Synced
+        {
+            get { lock (syncLock) return rounds.Count > 0; }
+        }
+
+        /// <summary>Estimated drift of the device clock (ppm, positive when it is slow).</summary>
+        public double DriftPpm
+        {
+            get { lock (syncLock) return drift * 1e6; }
+        }
+
+        /// <summary>
+        /// Starts a round, returns the first command to send.
+        /// </summary>
+        public byte[] Start()
+        {
+            lock (syncLock)
+            {
+                best = null;
+                exchanges = 0;
+                return Protocol.SyncTime((uint)HostMs);
+            }
+        }
+
+        /// <summary>
+        /// Handles a CmdTimeSync reply received at hostMs. Returns the next command of the
+        /// round, or null when the round is complete.
+        /// </summary>
+        public byte[] Reply(byte[] payload, long hostMs)
+        {
+            if (payload.Length < 13 || payload[0] != Protocol.CmdOk)
+                return null;
+            lock (syncLock)
+            {
+                long t4 = hostMs;
+                long t1 = t4 - (uint)((uint)t4 - BitConverter.ToUInt32(payload, 1));
+                long t2 = Unwrap(BitConverter.ToUInt32(payload, 5));
+                long t3 = Unwrap(BitConverter.ToUInt32(payload, 9));
+
+                Round r = new Round();
+                r.Device = t3;
+                r.Offset = ((t1 - t2) + (t4 - t3)) / 2.0;
+                r.Bound = ((t4 - t1) - (t3 - t2)) / 2.0 + Resolution;
+                if (best == null || r.Bound < best.Bound)
+                    best = r;
+                if (++exchanges < Exchanges)
+                    return Protocol.SyncTime((uint)HostMs);
+
+                rounds.Add(best);
+                if (rounds.Count > MaxRounds)
+                    rounds.RemoveAt(0);
+                EstimateDrift();
+                return null;
+            }
+        }
+
+        /// <summary>
+        /// Converts a device time to the host clock (ms, see WallClock). Returns false if
+        /// the clocks are not synchronized yet.
+        /// </summary>
+        public bool ToHost(uint deviceMs, out double hostMs, out double bound)
+        {
+            hostMs = bound = 0;
+            lock (syncLock)
+            {
+                if (rounds.Count == 0)
+                    return false;
+                long d = Unwrap(deviceMs);
+                Round last = rounds[rounds.Count - 1];
+                hostMs = d + last.Offset + drift * (d - last.Device);
+                bound = last.Bound + driftBound * Math.Abs(d - last.Device);
+                return true;
+            }
+        }
+
+        /// <summary>Unwraps a 32 bit device time, next to the last one seen.</summary>
+        long Unwrap(uint value)
+        {
+            if (!deviceSeen)
+            {
+                deviceSeen = true;
+                device = value;
+            }
+            long d = device + (int)(value - (uint)device);
+            if (d > device)
+                device = d;
+            return d;
+        }
+
+        /// <summary>Least squares slope of the offsets, and its bound from the offset bounds.</summary>
+        void EstimateDrift()
+        {
+            Round first = rounds[0];
+            Round last = rounds[rounds.Count - 1];
+            double span = last.Device - first.Device;
+            if (rounds.Count < 2 || span <= 0)
+                return;
+
+            double mx = 0, my = 0;
+            foreach (Round r in rounds)
+            {
+                mx += r.Device - first.Device;
+                my += r.Offset;
+            }
+            mx /= rounds.Count;
+            my /= rounds.Count;
+            double sxy = 0, sxx = 0;
+            foreach (Round r in rounds)
+            {
+                double x = r.Device - first.Device - mx;
+                sxy += x * (r.Offset - my);
+                sxx += x * x;
+            }
+            drift = sxy / sxx;
+            driftBound = Math.Min(UnknownDrift, (first.Bound + last.Bound) / span);
+        }
+    }
+}